@@ -0,0 +1,192 @@
+/**
+ * @file arena.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_ARENA_H
+#define CBERL_ARENA_H
+
+#include <folly/Range.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace cb {
+
+/**
+ * @c Arena is a bump allocator holding all memory of a single batch.
+ * Individual allocations are never freed; the whole arena is reset at
+ * once when the batch is done with it. Arenas are recycled through
+ * a per-thread pool, so a steady stream of batches does not touch the
+ * global allocator at all.
+ */
+class Arena {
+public:
+    /**
+     * Returns an empty arena from the pool of the calling thread. The
+     * arena is returned to the pool of the thread releasing the last
+     * reference.
+     */
+    static std::shared_ptr<Arena> acquire()
+    {
+        auto &arenas = pool();
+        std::unique_ptr<Arena> arena;
+        if (arenas.empty()) {
+            arena.reset(new Arena{});
+        }
+        else {
+            arena = std::move(arenas.back());
+            arenas.pop_back();
+        }
+
+        return {arena.release(), &Arena::recycle};
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(std::size_t size,
+        std::size_t alignment = alignof(std::max_align_t))
+    {
+        auto offset = (m_used + alignment - 1) & ~(alignment - 1);
+        if (m_blocks.empty() || offset + size > m_blocks.back().size) {
+            addBlock(size + alignment);
+            offset = (m_used + alignment - 1) & ~(alignment - 1);
+        }
+
+        m_used = offset + size;
+        return m_blocks.back().data.get() + offset;
+    }
+
+    /**
+     * Copies @c size bytes of @c data into the arena.
+     */
+    folly::StringPiece copy(const void *data, std::size_t size)
+    {
+        if (size == 0)
+            return {};
+
+        auto dest = static_cast<char *>(allocate(size, 1));
+        std::memcpy(dest, data, size);
+        return {dest, size};
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t kBlockSize = 4096;
+    static constexpr std::size_t kMaxPooledBlockSize = 1 << 20;
+    static constexpr std::size_t kMaxPooledArenas = 64;
+
+    Arena() = default;
+
+    static std::vector<std::unique_ptr<Arena>> &pool()
+    {
+        thread_local std::vector<std::unique_ptr<Arena>> arenas;
+        return arenas;
+    }
+
+    static void recycle(Arena *arena)
+    {
+        std::unique_ptr<Arena> ptr{arena};
+        auto &arenas = pool();
+        if (arenas.size() < kMaxPooledArenas) {
+            ptr->reset();
+            arenas.emplace_back(std::move(ptr));
+        }
+    }
+
+    void addBlock(std::size_t minSize)
+    {
+        auto size = std::max(minSize,
+            m_blocks.empty() ? kBlockSize : 2 * m_blocks.back().size);
+        m_blocks.push_back(
+            Block{std::unique_ptr<unsigned char[]>{new unsigned char[size]},
+                size});
+        m_used = 0;
+    }
+
+    // Keeps only the largest block, unless it is too big to be pooled
+    void reset()
+    {
+        if (!m_blocks.empty()) {
+            auto block = std::move(m_blocks.back());
+            m_blocks.clear();
+            if (block.size <= kMaxPooledBlockSize)
+                m_blocks.emplace_back(std::move(block));
+        }
+        m_used = 0;
+    }
+
+    std::vector<Block> m_blocks;
+    std::size_t m_used{0};
+};
+
+using ArenaPtr = std::shared_ptr<Arena>;
+
+/**
+ * Standard allocator drawing memory from an @c Arena. An allocator
+ * without an arena falls back to the global allocator.
+ */
+template <class T> class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator(Arena *arena = nullptr) noexcept
+        : m_arena{arena}
+    {
+    }
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+        : m_arena{other.arena()}
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        if (!m_arena)
+            return std::allocator<T>{}.allocate(n);
+
+        return static_cast<T *>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        if (!m_arena)
+            std::allocator<T>{}.deallocate(p, n);
+    }
+
+    Arena *arena() const { return m_arena; }
+
+private:
+    Arena *m_arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+    return lhs.arena() == rhs.arena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace cb
+
+#endif // CBERL_ARENA_H
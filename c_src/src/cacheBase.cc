@@ -0,0 +1,48 @@
+/**
+ * @file cacheBase.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "cacheBase.h"
+
+namespace cb {
+
+void CacheBase::cancelFill(folly::StringPiece key) { takeFill(key); }
+
+CacheBase::Stats CacheBase::stats() const
+{
+    Stats stats;
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void CacheBase::hit() { m_hits.fetch_add(1, std::memory_order_relaxed); }
+
+void CacheBase::miss(folly::StringPiece key)
+{
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    ++m_pending[key.str()];
+}
+
+bool CacheBase::takeFill(folly::StringPiece key)
+{
+    auto pending = m_pending.find(key.str());
+    if (pending == m_pending.end())
+        return false;
+
+    if (--pending->second == 0)
+        m_pending.erase(pending);
+
+    return true;
+}
+
+void CacheBase::cancelFills(folly::StringPiece key)
+{
+    if (!m_pending.empty())
+        m_pending.erase(key.str());
+}
+
+} // namespace cb
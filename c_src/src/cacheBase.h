@@ -0,0 +1,90 @@
+/**
+ * @file cacheBase.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_CACHE_BASE_H
+#define CBERL_CACHE_BASE_H
+
+#include <folly/Range.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace cb {
+
+/**
+ * @c CacheBase keeps what the caches of a connection have in common:
+ * the counters of their lookups and the fills they expect. A lookup that
+ * misses registers a fill of its key, to be made by the response to the
+ * get sent in its place. A fill is made only if it is still registered,
+ * so a key invalidated while its get was in flight is not cached with a
+ * stale result.
+ *
+ * Counters can be read from any thread, everything else is used only on
+ * the event base of the connection.
+ */
+class CacheBase {
+public:
+    struct Stats {
+        // Gets answered locally, i.e. round trips saved
+        std::uint64_t hits{0};
+        std::uint64_t misses{0};
+    };
+
+    CacheBase(const CacheBase &) = delete;
+    CacheBase &operator=(const CacheBase &) = delete;
+
+    /**
+     * Drops a fill registered by a lookup, for a get whose response will
+     * not fill the cache.
+     */
+    void cancelFill(folly::StringPiece key);
+
+    Stats stats() const;
+
+protected:
+    struct Hash {
+        std::size_t operator()(folly::StringPiece key) const
+        {
+            return key.hash();
+        }
+    };
+
+    CacheBase() = default;
+
+    ~CacheBase() = default;
+
+    void hit();
+
+    /**
+     * Counts a miss and registers a fill of the key.
+     */
+    void miss(folly::StringPiece key);
+
+    /**
+     * Takes a fill of the key, returning @c false if none is registered.
+     */
+    bool takeFill(folly::StringPiece key);
+
+    /**
+     * Cancels all fills of the key.
+     */
+    void cancelFills(folly::StringPiece key);
+
+private:
+    // Keys with gets sent to the server, which may fill the cache
+    std::unordered_map<std::string, std::size_t> m_pending;
+
+    std::atomic<std::uint64_t> m_hits{0};
+    std::atomic<std::uint64_t> m_misses{0};
+};
+
+} // namespace cb
+
+#endif // CBERL_CACHE_BASE_H
@@ -14,48 +14,314 @@
 #include "requests/requests.h"
 #include "responses/responses.h"
 
+#include <folly/Range.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
-#include <random>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace {
+
+/**
+ * Decodes a single field of a request tuple.
+ */
+template <typename T> struct Decoder {
+    static T decode(ErlNifEnv *env, ErlNifEnv *, ERL_NIF_TERM term)
+    {
+        return nifpp::get<T>(env, term);
+    }
+};
+
+/**
+ * Decodes a binary without copying its data. The binary is copied into
+ * the process independent @c owner environment, which shares the data
+ * with the caller and keeps it alive for the lifetime of the request.
+ */
+template <> struct Decoder<folly::StringPiece> {
+    static folly::StringPiece decode(
+        ErlNifEnv *env, ErlNifEnv *owner, ERL_NIF_TERM term)
+    {
+        ErlNifBinary bin;
+        if (!enif_is_binary(env, term) ||
+            !enif_inspect_binary(owner, enif_make_copy(owner, term), &bin))
+            throw nifpp::badarg{};
+
+        return {reinterpret_cast<const char *>(bin.data), bin.size};
+    }
+};
+
+// Batches of up to this many requests are decoded within a single
+// timeslice of a normal scheduler
+constexpr unsigned int kMaxScheduledBatchSize = 1000;
+
+/**
+ * Checks whether a batch is too large to be decoded on a normal
+ * scheduler, so the NIF should be rescheduled to a dirty scheduler.
+ * Invalid batches are left for the NIF to reject.
+ */
+bool oversized(ErlNifEnv *env, ERL_NIF_TERM term)
+{
+    unsigned int length = 0;
+    return enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER &&
+        enif_get_list_length(env, term, &length) &&
+        length > kMaxScheduledBatchSize;
+}
+
+template <class RequestT, class... Ts, std::size_t... Is>
+RequestT decodeRequest(ErlNifEnv *env, ErlNifEnv *owner,
+    const ERL_NIF_TERM *fields, std::index_sequence<Is...>)
+{
+    return RequestT{Decoder<Ts>::decode(env, owner, fields[Is])...};
+}
+
+/**
+ * Decodes a list of request tuples of type @c Ts in a single pass,
+ * writing libcouchbase commands straight into a buffer preallocated for
+ * the whole list.
+ */
+template <class RequestT, class... Ts>
+cb::MultiRequest<RequestT> decodeRequests(ErlNifEnv *env, ERL_NIF_TERM term)
+{
+    unsigned int length = 0;
+    if (!enif_get_list_length(env, term, &length))
+        throw nifpp::badarg{};
+
+    Env owner;
+    cb::MultiRequest<RequestT> request{length, owner.shared()};
+
+    ERL_NIF_TERM head;
+    ERL_NIF_TERM tail = term;
+    while (enif_get_list_cell(env, tail, &head, &tail)) {
+        int arity = 0;
+        const ERL_NIF_TERM *fields = nullptr;
+        if (!enif_get_tuple(env, head, &arity, &fields) ||
+            arity != sizeof...(Ts))
+            throw nifpp::badarg{};
+
+        request.add(decodeRequest<RequestT, Ts...>(
+            env, owner.get(), fields, std::index_sequence_for<Ts...>{}));
+    }
+
+    // Accounts for the decoding, so that the scheduler can yield to
+    // other processes in time
+    if (enif_thread_type() == ERL_NIF_THR_NORMAL_SCHEDULER) {
+        auto percent = length * 100 / kMaxScheduledBatchSize;
+        enif_consume_timeslice(env, std::max(1u, std::min(100u, percent)));
+    }
+
+    return request;
+}
+
 class NifCTX {
 public:
+    /**
+     * Reads the process the response is sent to, given either as a pid
+     * or as @c {Pid, Deadline} where the deadline is the monotonic time,
+     * in milliseconds, after which the process no longer waits for it.
+     */
     NifCTX(ErlNifEnv *env_, const ERL_NIF_TERM argv[])
-        : reqPid{nifpp::get<ErlNifPid>(env_, argv[0])}
-        , reqId(std::make_tuple(dist(gen), dist(gen), dist(gen)))
+        : reqId{nextRequestId()}
     {
+        int arity = 0;
+        const ERL_NIF_TERM *replyTo = nullptr;
+        if (!enif_get_tuple(env_, argv[0], &arity, &replyTo)) {
+            reqPid = nifpp::get<ErlNifPid>(env_, argv[0]);
+            return;
+        }
+
+        ErlNifSInt64 deadlineMs = 0;
+        if (arity != 2 || !enif_get_int64(env_, replyTo[1], &deadlineMs))
+            throw nifpp::badarg{};
+
+        reqPid = nifpp::get<ErlNifPid>(env_, replyTo[0]);
+        deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds{
+                deadlineMs - enif_monotonic_time(ERL_NIF_MSEC)};
     }
 
-    template <typename T> int send(T &&value) const
+    template <typename T> int send(const Env &env, T &&value) const
     {
         return enif_send(nullptr, &reqPid, env,
             nifpp::make(env, std::make_tuple(reqId, std::forward<T>(value))));
     }
 
-    Env env;
+    /**
+     * Sends the response from its own environment, where small batches
+     * are already encoded.
+     */
+    template <typename ResponseT>
+    int send(const cb::MultiResponse<ResponseT> &response) const
+    {
+        // Nobody waits for an expired response anymore
+        if (response.expired())
+            return 0;
+
+        auto env = response.env() ? response.env() : Env{};
+        return send(env, response.toTerm(env));
+    }
+
+    /**
+     * Sends responses of a streamed batch received since its last chunk.
+     */
+    template <typename ResponseT>
+    int sendChunk(const cb::MultiResponse<ResponseT> &response) const
+    {
+        auto env = response.env() ? response.env() : Env{};
+        return send(env, response.chunkToTerm(env));
+    }
+
+    /**
+     * Completes a streamed batch by sending its last chunk followed by
+     * @c done, or the error of the batch.
+     */
+    template <typename ResponseT>
+    void sendLast(const cb::MultiResponse<ResponseT> &response) const
+    {
+        if (response.error() != LCB_SUCCESS) {
+            send(response);
+            return;
+        }
+
+        if (!response.empty())
+            sendChunk(response);
+
+        Env msgEnv;
+        send(msgEnv, nifpp::str_atom{"done"});
+    }
+
     ErlNifPid reqPid;
-    std::tuple<int, int, int> reqId;
+    std::uint64_t reqId;
+    std::chrono::steady_clock::time_point deadline{
+        std::chrono::steady_clock::time_point::max()};
 
 private:
-    static thread_local std::random_device rd;
-    static thread_local std::default_random_engine gen;
-    static thread_local std::uniform_int_distribution<int> dist;
+    /**
+     * Returns a request id unique within the VM. Each scheduler thread
+     * numbers its requests with its own counter, tagged with an index
+     * assigned to the thread on its first request. Ids stay below 2^56,
+     * so they are small integers in Erlang.
+     */
+    static std::uint64_t nextRequestId()
+    {
+        static std::atomic<std::uint64_t> nextThreadIndex{0};
+        thread_local std::uint64_t threadIndex{nextThreadIndex++};
+        thread_local std::uint64_t counter{0};
+
+        return ((threadIndex & 0xFFFF) << 40) |
+            (++counter & ((std::uint64_t{1} << 40) - 1));
+    }
 };
 
-thread_local std::random_device NifCTX::rd{};
-thread_local std::default_random_engine NifCTX::gen{NifCTX::rd()};
-thread_local std::uniform_int_distribution<int> NifCTX::dist{};
+/**
+ * Returns the id of a submitted request, or the error it has been
+ * rejected with, e.g. 'ebusy' if it is over the in-flight limit of the
+ * connection.
+ */
+ERL_NIF_TERM submitted(ErlNifEnv *env, const NifCTX &ctx, lcb_error_t err)
+{
+    if (err != LCB_SUCCESS) {
+        Env msgEnv;
+        return enif_make_copy(env, cb::Response{err}.toTerm(msgEnv));
+    }
+
+    return nifpp::make(env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+}
+
+/**
+ * Decodes streaming options of a batch. Chunks are sent to the caller
+ * every 'chunk_size' responses and, if 'chunk_interval' is given, every
+ * that many microseconds.
+ */
+template <class ResponseT>
+cb::StreamPtr<ResponseT> decodeStream(
+    ErlNifEnv *env, ERL_NIF_TERM term, const NifCTX &ctx)
+{
+    int chunkSize = 256;
+    int chunkInterval = 0;
+    std::string optName;
+    int optValue;
+    for (const auto &option :
+        nifpp::get<std::vector<std::tuple<nifpp::str_atom, int>>>(env, term)) {
+        std::tie(optName, optValue) = option;
+        if (optName == "chunk_size") {
+            if (optValue < 1)
+                throw nifpp::badarg{};
+            chunkSize = optValue;
+        }
+        else if (optName == "chunk_interval") {
+            if (optValue < 0)
+                throw nifpp::badarg{};
+            chunkInterval = optValue;
+        }
+    }
+
+    return std::make_shared<cb::Stream<ResponseT>>(
+        cb::Stream<ResponseT>{static_cast<std::size_t>(chunkSize),
+            std::chrono::microseconds{chunkInterval},
+            [ctx](const cb::MultiResponse<ResponseT> &responses) {
+                ctx.sendChunk(responses);
+            }});
+}
+
+/**
+ * @c Caller is a resource monitoring the process a request has been
+ * submitted by. Its flag is raised once the process goes down, so that
+ * the batch of the request is dropped. The monitor is removed with the
+ * resource, once the batch is completed.
+ */
+struct Caller {
+    std::atomic<bool> gone{false};
+    ErlNifMonitor monitor;
+};
+
+ErlNifResourceType *callerType = nullptr;
+
+void callerDown(ErlNifEnv *env, void *obj, ErlNifPid *pid, ErlNifMonitor *mon)
+{
+    static_cast<Caller *>(obj)->gone.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Monitors the caller of a request and returns the flag raised once it
+ * is gone.
+ */
+std::shared_ptr<const std::atomic<bool>> watchCaller(
+    ErlNifEnv *env, const NifCTX &ctx)
+{
+    auto caller = new (enif_alloc_resource(callerType, sizeof(Caller))) Caller;
+
+    // A positive result means the process is not alive anymore
+    if (enif_monitor_process(env, caller, &ctx.reqPid, &caller->monitor) > 0)
+        caller->gone.store(true, std::memory_order_relaxed);
+
+    return std::shared_ptr<const std::atomic<bool>>{
+        &caller->gone, [caller](const std::atomic<bool> *) {
+            enif_release_resource(caller);
+        }};
+}
 } // namespace
 
 extern "C" {
 
 static int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info)
 {
-    return !(nifpp::register_resource<cb::ClientPtr>(env, nullptr, "Client") &&
+    cb::Response::loadAtoms(env);
+
+    ErlNifResourceTypeInit callerInit{nullptr, nullptr, callerDown};
+    callerType = enif_open_resource_type_x(env, "Caller", &callerInit,
+        ErlNifResourceFlags(ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER),
+        nullptr);
+
+    return !(callerType &&
+        nifpp::register_resource<cb::ClientPtr>(env, nullptr, "Client") &&
         nifpp::register_resource<cb::ConnectionPtr>(
-            env, nullptr, "Connection"));
+            env, nullptr, "Connection") &&
+        nifpp::register_resource<cb::BufferPtr>(env, nullptr, "Buffer"));
 }
 
 static int upgrade(
@@ -67,8 +333,22 @@ static int upgrade(
 static ERL_NIF_TERM new_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
     try {
+        int workerCount = 1;
+        std::string optName;
+        int optValue;
+        for (const auto &option :
+            nifpp::get<std::vector<std::tuple<nifpp::str_atom, int>>>(
+                env, argv[0])) {
+            std::tie(optName, optValue) = option;
+            if (optName == "worker_count") {
+                if (optValue < 1 || optValue > UINT16_MAX)
+                    throw nifpp::badarg{};
+                workerCount = optValue;
+            }
+        }
+
         auto client = nifpp::construct_resource<cb::ClientPtr>(
-            std::make_shared<cb::Client>());
+            std::make_shared<cb::Client>(workerCount));
         return nifpp::make(
             env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(client)));
     }
@@ -91,9 +371,13 @@ static ERL_NIF_TERM connect_nif(
             nifpp::get<std::vector<std::tuple<nifpp::str_atom, int>>>(
                 env, argv[6])};
 
+        if (request.shards() > cb::ConnectRequest::kMaxShards)
+            throw nifpp::badarg{};
+
         client->connect(
             std::move(request), [ctx](const cb::ConnectResponse &response) {
-                ctx.send(response.toTerm(ctx.env));
+                Env msgEnv;
+                ctx.send(msgEnv, response.toTerm(msgEnv));
             });
 
         return nifpp::make(
@@ -106,21 +390,37 @@ static ERL_NIF_TERM connect_nif(
 
 static ERL_NIF_TERM get_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (oversized(env, argv[3]))
+        return enif_schedule_nif(env, "get", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            get_nif, argc, argv);
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::GetRequest> request{
-            nifpp::get<std::vector<cb::GetRequest::Raw>>(env, argv[3])};
-
-        client->get(std::move(connection), std::move(request),
-            [ctx](const cb::MultiResponse<cb::GetResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
-            });
-
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        auto request = decodeRequests<cb::GetRequest, folly::StringPiece,
+            lcb_time_t, bool>(env, argv[3]);
+        request.setDeadline(ctx.deadline);
+        request.setAbandoned(watchCaller(env, ctx));
+
+        lcb_error_t err;
+        if (argc > 4) {
+            auto stream = decodeStream<cb::GetResponse>(env, argv[4], ctx);
+            err = client->get(std::move(connection), std::move(request),
+                [ctx](const cb::MultiResponse<cb::GetResponse> &responses) {
+                    ctx.sendLast(responses);
+                },
+                std::move(stream));
+        }
+        else {
+            err = client->get(std::move(connection), std::move(request),
+                [ctx](const cb::MultiResponse<cb::GetResponse> &responses) {
+                    ctx.send(responses);
+                });
+        }
+
+        return submitted(env, ctx, err);
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -130,21 +430,27 @@ static ERL_NIF_TERM get_nif(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 static ERL_NIF_TERM store_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (oversized(env, argv[3]))
+        return enif_schedule_nif(env, "store", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            store_nif, argc, argv);
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::StoreRequest> request{
-            nifpp::get<std::vector<cb::StoreRequest::Raw>>(env, argv[3])};
+        auto request = decodeRequests<cb::StoreRequest, int,
+            folly::StringPiece, folly::StringPiece, lcb_uint32_t, lcb_cas_t,
+            lcb_time_t>(env, argv[3]);
+        request.setDeadline(ctx.deadline);
+        request.setAbandoned(watchCaller(env, ctx));
 
-        client->store(std::move(connection), std::move(request),
+        auto err = client->store(std::move(connection), std::move(request),
             [ctx](const cb::MultiResponse<cb::StoreResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return submitted(env, ctx, err);
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -154,21 +460,26 @@ static ERL_NIF_TERM store_nif(
 static ERL_NIF_TERM remove_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (oversized(env, argv[3]))
+        return enif_schedule_nif(env, "remove", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            remove_nif, argc, argv);
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::RemoveRequest> request{
-            nifpp::get<std::vector<cb::RemoveRequest::Raw>>(env, argv[3])};
+        auto request = decodeRequests<cb::RemoveRequest, folly::StringPiece,
+            lcb_cas_t>(env, argv[3]);
+        request.setDeadline(ctx.deadline);
+        request.setAbandoned(watchCaller(env, ctx));
 
-        client->remove(std::move(connection), std::move(request),
+        auto err = client->remove(std::move(connection), std::move(request),
             [ctx](const cb::MultiResponse<cb::RemoveResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return submitted(env, ctx, err);
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -178,21 +489,27 @@ static ERL_NIF_TERM remove_nif(
 static ERL_NIF_TERM arithmetic_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (oversized(env, argv[3]))
+        return enif_schedule_nif(env, "arithmetic", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            arithmetic_nif, argc, argv);
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::ArithmeticRequest> request{
-            nifpp::get<std::vector<cb::ArithmeticRequest::Raw>>(env, argv[3])};
+        auto request = decodeRequests<cb::ArithmeticRequest,
+            folly::StringPiece, std::int64_t, bool, std::uint64_t,
+            lcb_time_t>(env, argv[3]);
+        request.setDeadline(ctx.deadline);
+        request.setAbandoned(watchCaller(env, ctx));
 
-        client->arithmetic(std::move(connection), std::move(request),
+        auto err = client->arithmetic(std::move(connection), std::move(request),
             [ctx](const cb::MultiResponse<cb::ArithmeticResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return submitted(env, ctx, err);
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -211,7 +528,8 @@ static ERL_NIF_TERM http_nif(
 
         client->http(std::move(connection), std::move(request),
             [ctx](const cb::HttpResponse &response) {
-                ctx.send(response.toTerm(ctx.env));
+                Env msgEnv;
+                ctx.send(msgEnv, response.toTerm(msgEnv));
             });
 
         return nifpp::make(
@@ -225,24 +543,139 @@ static ERL_NIF_TERM http_nif(
 static ERL_NIF_TERM durability_nif(
     ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 {
+    if (oversized(env, argv[3]))
+        return enif_schedule_nif(env, "durability", ERL_NIF_DIRTY_JOB_CPU_BOUND,
+            durability_nif, argc, argv);
+
     try {
         NifCTX ctx{env, argv};
 
         auto client = nifpp::get<cb::ClientPtr>(env, argv[1]);
         auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[2]);
-        cb::MultiRequest<cb::DurabilityRequest> request{
-            nifpp::get<std::vector<cb::DurabilityRequest::Raw>>(env, argv[3])};
+        auto request = decodeRequests<cb::DurabilityRequest,
+            folly::StringPiece, lcb_cas_t>(env, argv[3]);
+        request.setDeadline(ctx.deadline);
+        request.setAbandoned(watchCaller(env, ctx));
         cb::DurabilityRequestOptions options{
             nifpp::get<cb::DurabilityRequestOptions::Raw>(env, argv[4])};
 
-        client->durability(std::move(connection), std::move(request),
+        auto err = client->durability(std::move(connection), std::move(request),
             std::move(options),
             [ctx](const cb::MultiResponse<cb::DurabilityResponse> &responses) {
-                ctx.send(responses.toTerm(ctx.env));
+                ctx.send(responses);
             });
 
-        return nifpp::make(
-            env, std::make_tuple(nifpp::str_atom{"ok"}, ctx.reqId));
+        return submitted(env, ctx, err);
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM near_cache_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+        auto stats = connection->nearCacheStats();
+
+        return nifpp::make(env,
+            std::make_tuple(nifpp::str_atom{"ok"},
+                std::vector<std::tuple<nifpp::str_atom, std::uint64_t>>{
+                    std::make_tuple(nifpp::str_atom{"hits"}, stats.hits),
+                    std::make_tuple(
+                        nifpp::str_atom{"misses"}, stats.misses)}));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM negative_cache_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+        auto stats = connection->negativeCacheStats();
+
+        return nifpp::make(env,
+            std::make_tuple(nifpp::str_atom{"ok"},
+                std::vector<std::tuple<nifpp::str_atom, std::uint64_t>>{
+                    std::make_tuple(nifpp::str_atom{"hits"}, stats.hits),
+                    std::make_tuple(
+                        nifpp::str_atom{"misses"}, stats.misses)}));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM hedged_read_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+        auto stats = connection->hedgedReadStats();
+
+        return nifpp::make(env,
+            std::make_tuple(nifpp::str_atom{"ok"},
+                std::vector<std::tuple<nifpp::str_atom, std::uint64_t>>{
+                    std::make_tuple(nifpp::str_atom{"hedged"}, stats.hedged),
+                    std::make_tuple(nifpp::str_atom{"replica_answers"},
+                        stats.replicaAnswers)}));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM buffer_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+
+        return nifpp::make(env,
+            std::make_tuple(nifpp::str_atom{"ok"},
+                std::vector<std::tuple<nifpp::str_atom, std::uint64_t>>{
+                    std::make_tuple(nifpp::str_atom{"retained"},
+                        connection->retainedBuffers())}));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM request_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+
+        return nifpp::make(env,
+            std::make_tuple(nifpp::str_atom{"ok"},
+                std::vector<std::tuple<nifpp::str_atom, std::uint64_t>>{
+                    std::make_tuple(nifpp::str_atom{"dropped"},
+                        connection->droppedBatches())}));
+    }
+    catch (const nifpp::badarg &) {
+        return enif_make_badarg(env);
+    }
+}
+
+static ERL_NIF_TERM single_flight_stats_nif(
+    ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
+{
+    try {
+        auto connection = nifpp::get<cb::ConnectionPtr>(env, argv[0]);
+        auto stats = connection->singleFlightStats();
+
+        return nifpp::make(env,
+            std::make_tuple(nifpp::str_atom{"ok"},
+                std::vector<std::tuple<nifpp::str_atom, std::uint64_t>>{
+                    std::make_tuple(
+                        nifpp::str_atom{"flights"}, stats.flights),
+                    std::make_tuple(nifpp::str_atom{"joins"}, stats.joins)}));
     }
     catch (const nifpp::badarg &) {
         return enif_make_badarg(env);
@@ -250,14 +683,21 @@ static ERL_NIF_TERM durability_nif(
 }
 
 static ErlNifFunc nif_funcs[] = {
-    {"new", 0, new_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"connect", 7, connect_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"get", 4, get_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"store", 4, store_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"remove", 4, remove_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"arithmetic", 4, arithmetic_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"http", 4, http_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
-    {"durability", 5, durability_nif, ERL_NIF_DIRTY_JOB_IO_BOUND}};
+    {"new", 1, new_nif, ERL_NIF_DIRTY_JOB_IO_BOUND},
+    {"connect", 7, connect_nif, 0},
+    {"get", 4, get_nif, 0},
+    {"get", 5, get_nif, 0},
+    {"store", 4, store_nif, 0},
+    {"remove", 4, remove_nif, 0},
+    {"arithmetic", 4, arithmetic_nif, 0},
+    {"http", 4, http_nif, 0},
+    {"durability", 5, durability_nif, 0},
+    {"near_cache_stats", 1, near_cache_stats_nif, 0},
+    {"negative_cache_stats", 1, negative_cache_stats_nif, 0},
+    {"hedged_read_stats", 1, hedged_read_stats_nif, 0},
+    {"single_flight_stats", 1, single_flight_stats_nif, 0},
+    {"request_stats", 1, request_stats_nif, 0},
+    {"buffer_stats", 1, buffer_stats_nif, 0}};
 
 ERL_NIF_INIT(cberl_nif, nif_funcs, load, NULL, upgrade, NULL)
 }
@@ -8,10 +8,47 @@
 #include "client.h"
 #include "connection.h"
 
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+/**
+ * Collects responses of per-shard sub-batches and emits a single merged
+ * response once all shards have completed.
+ */
+template <class ResponseT> class ShardedResponse {
+public:
+    ShardedResponse(
+        std::size_t shardCount, cb::Callback<cb::MultiResponse<ResponseT>> cb)
+        : m_shardsLeft{shardCount}
+        , m_callback{std::move(cb)}
+    {
+    }
+
+    void add(const cb::MultiResponse<ResponseT> &response)
+    {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_response.merge(response);
+        if (--m_shardsLeft == 0) {
+            lock.unlock();
+            m_callback(m_response);
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::size_t m_shardsLeft;
+    cb::MultiResponse<ResponseT> m_response;
+    cb::Callback<cb::MultiResponse<ResponseT>> m_callback;
+};
+
+} // namespace
+
 namespace cb {
 
-Client::Client()
-    : m_workerCount{1}
+Client::Client(unsigned short workerCount)
+    : m_workerCount{workerCount}
 {
     m_executor = std::make_shared<folly::IOThreadPoolExecutor>(m_workerCount,
         std::make_shared<folly::NamedThreadFactory>("CBerlThreadPool"));
@@ -21,13 +58,37 @@ Client::~Client() { m_executor->join(); }
 
 void Client::connect(ConnectRequest request, Callback<ConnectResponse> callback)
 {
-    m_executor->add([
-            &, connection = std::make_shared<Connection>(),
+    // The limit is set on the connection handed over to the caller, so
+    // a sharded connection is limited as a whole
+    auto limit = request.inFlightLimit();
+    if (limit.enabled()) {
+        callback = [limit, callback = std::move(callback)](
+                       const ConnectResponse &response) {
+            if (auto connection = response.connection()) {
+                connection->setInFlightLimit(
+                    std::make_unique<InFlightLimit>(limit));
+            }
+            callback(response);
+        };
+    }
+
+    if (request.shards() > 1)
+        connectSharded(std::move(request), std::move(callback));
+    else
+        connectInstance(std::move(request), std::move(callback));
+}
+
+void Client::connectInstance(
+    ConnectRequest request, Callback<ConnectResponse> callback)
+{
+    auto eventBase = m_executor->getEventBase();
+    eventBase->runInEventBaseThread([
+        this, eventBase, connection = std::make_shared<Connection>(),
         request = std::move(request), callback = std::move(callback)
     ] {
         try {
-            connection->bootstrap(
-                request, m_executor->getEventBase(), std::move(callback));
+            connection->bootstrap(request, eventBase, callback);
+            std::lock_guard<std::mutex> guard{m_connectionsMutex};
             m_connections.push_back(connection);
         }
         catch (lcb_error_t err) {
@@ -36,64 +97,239 @@ void Client::connect(ConnectRequest request, Callback<ConnectResponse> callback)
     });
 }
 
-void Client::get(ConnectionPtr connection, MultiRequest<GetRequest> request,
-    Callback<MultiResponse<GetResponse>> callback)
+void Client::connectSharded(
+    ConnectRequest request, Callback<ConnectResponse> callback)
 {
-    m_executor->add([
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { connection->get(request, std::move(callback)); });
+    struct ShardedConnect {
+        std::mutex mutex;
+        std::size_t shardsLeft;
+        lcb_error_t err{LCB_SUCCESS};
+        std::vector<ConnectionPtr> shards;
+        Callback<ConnectResponse> callback;
+    };
+
+    auto shardCount = request.shards();
+    auto state = std::make_shared<ShardedConnect>();
+    state->shardsLeft = shardCount;
+    state->shards.resize(shardCount);
+    state->callback = std::move(callback);
+
+    // Each instance is bootstrapped on the next event base of the pool, so
+    // the shards are spread over the IO threads
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        connectInstance(
+            request, [this, state, i](const ConnectResponse &response) {
+                std::unique_lock<std::mutex> lock{state->mutex};
+                if (response.error() != LCB_SUCCESS) {
+                    if (state->err == LCB_SUCCESS)
+                        state->err = response.error();
+                }
+                else {
+                    state->shards[i] = response.connection();
+                }
+
+                if (--state->shardsLeft > 0)
+                    return;
+
+                lock.unlock();
+                if (state->err != LCB_SUCCESS) {
+                    // Shards that did connect are of no use on their own
+                    for (auto &shard : state->shards) {
+                        if (shard)
+                            disconnect(std::move(shard));
+                    }
+
+                    state->callback(ConnectResponse{state->err, nullptr});
+                    return;
+                }
+
+                auto connection = std::make_shared<Connection>();
+                connection->setShards(std::move(state->shards));
+                state->callback(ConnectResponse{LCB_SUCCESS, connection});
+            });
+    }
 }
 
-void Client::store(ConnectionPtr connection, MultiRequest<StoreRequest> request,
-    Callback<MultiResponse<StoreResponse>> callback)
+void Client::disconnect(ConnectionPtr connection)
 {
-    m_executor->add([
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { connection->store(request, std::move(callback)); });
+    {
+        std::lock_guard<std::mutex> guard{m_connectionsMutex};
+        m_connections.erase(std::remove(m_connections.begin(),
+                                m_connections.end(), connection),
+            m_connections.end());
+    }
+
+    auto eventBase = connection->eventBase();
+    eventBase->runInEventBaseThread(
+        [connection = std::move(connection)]() mutable { connection.reset(); });
 }
 
-void Client::remove(ConnectionPtr connection,
+template <class RequestT, class ResponseT, class SubmitT>
+lcb_error_t Client::admit(ConnectionPtr connection,
+    MultiRequest<RequestT> request,
+    Callback<MultiResponse<ResponseT>> callback, SubmitT submit)
+{
+    if (request.abandoned() ||
+        request.deadline() != std::chrono::steady_clock::time_point::max()) {
+        callback = [connection, callback = std::move(callback)](
+            const MultiResponse<ResponseT> &response) {
+            if (response.expired())
+                connection->countDropped();
+
+            callback(response);
+        };
+    }
+
+    auto limit = connection->inFlightLimit();
+    if (!limit) {
+        dispatch(std::move(connection), std::move(request),
+            std::move(callback), std::move(submit));
+        return LCB_SUCCESS;
+    }
+
+    auto ops = request.size();
+    auto bytes = request.bytes();
+
+    auto admitted = limit->admit(ops, bytes, [
+        this, limit, connection, request = std::move(request),
+        callback = std::move(callback), submit = std::move(submit), ops, bytes
+    ]() mutable {
+        auto start = std::chrono::steady_clock::now();
+
+        // The connection keeps the limit alive until the request is done
+        dispatch(connection, std::move(request),
+            Callback<MultiResponse<ResponseT>>{
+                [limit, connection, callback = std::move(callback), ops,
+                    bytes, start](const MultiResponse<ResponseT> &response) {
+                    callback(response);
+                    limit->release(
+                        ops, bytes, std::chrono::steady_clock::now() - start);
+                }},
+            std::move(submit));
+    });
+
+    return admitted ? LCB_SUCCESS : LCB_EBUSY;
+}
+
+template <class RequestT, class ResponseT, class SubmitT>
+void Client::dispatch(ConnectionPtr connection, MultiRequest<RequestT> request,
+    Callback<MultiResponse<ResponseT>> callback, SubmitT submit)
+{
+    const auto &shards = connection->shards();
+
+    if (shards.empty()) {
+        auto eventBase = connection->eventBase();
+        eventBase->runInEventBaseThread([
+            connection = std::move(connection), request = std::move(request),
+            callback = std::move(callback), submit = std::move(submit)
+        ] { submit(*connection, request, std::move(callback)); });
+        return;
+    }
+
+    auto requests = request.shard(shards.size());
+    auto shardCount = std::count_if(requests.begin(), requests.end(),
+        [](const auto &r) { return !r.empty(); });
+
+    if (shardCount == 0) {
+        dispatch(shards.front(), std::move(request), std::move(callback),
+            std::move(submit));
+        return;
+    }
+
+    auto response = std::make_shared<ShardedResponse<ResponseT>>(
+        shardCount, std::move(callback));
+
+    for (std::size_t i = 0; i < shards.size(); ++i) {
+        if (requests[i].empty())
+            continue;
+
+        dispatch(shards[i], std::move(requests[i]),
+            Callback<MultiResponse<ResponseT>>{
+                [response](const MultiResponse<ResponseT> &shardResponse) {
+                    response->add(shardResponse);
+                }},
+            submit);
+    }
+}
+
+lcb_error_t Client::get(ConnectionPtr connection,
+    MultiRequest<GetRequest> request,
+    Callback<MultiResponse<GetResponse>> callback,
+    StreamPtr<GetResponse> stream)
+{
+    return admit(std::move(connection), std::move(request), std::move(callback),
+        [stream = std::move(stream)](Connection &conn,
+            const MultiRequest<GetRequest> &req,
+            Callback<MultiResponse<GetResponse>> cb) {
+            conn.get(req, std::move(cb), stream);
+        });
+}
+
+lcb_error_t Client::store(ConnectionPtr connection,
+    MultiRequest<StoreRequest> request,
+    Callback<MultiResponse<StoreResponse>> callback,
+    StreamPtr<StoreResponse> stream)
+{
+    return admit(std::move(connection), std::move(request), std::move(callback),
+        [stream = std::move(stream)](Connection &conn,
+            const MultiRequest<StoreRequest> &req,
+            Callback<MultiResponse<StoreResponse>> cb) {
+            conn.store(req, std::move(cb), stream);
+        });
+}
+
+lcb_error_t Client::remove(ConnectionPtr connection,
     MultiRequest<RemoveRequest> request,
-    Callback<MultiResponse<RemoveResponse>> callback)
+    Callback<MultiResponse<RemoveResponse>> callback,
+    StreamPtr<RemoveResponse> stream)
 {
-    m_executor->add([
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { connection->remove(request, std::move(callback)); });
+    return admit(std::move(connection), std::move(request), std::move(callback),
+        [stream = std::move(stream)](Connection &conn,
+            const MultiRequest<RemoveRequest> &req,
+            Callback<MultiResponse<RemoveResponse>> cb) {
+            conn.remove(req, std::move(cb), stream);
+        });
 }
 
-void Client::arithmetic(ConnectionPtr connection,
+lcb_error_t Client::arithmetic(ConnectionPtr connection,
     MultiRequest<ArithmeticRequest> request,
-    Callback<MultiResponse<ArithmeticResponse>> callback)
+    Callback<MultiResponse<ArithmeticResponse>> callback,
+    StreamPtr<ArithmeticResponse> stream)
 {
-    m_executor->add([
-        connection = std::move(connection), request = std::move(request),
-        callback = std::move(callback)
-    ] { connection->arithmetic(request, std::move(callback)); });
+    return admit(std::move(connection), std::move(request), std::move(callback),
+        [stream = std::move(stream)](Connection &conn,
+            const MultiRequest<ArithmeticRequest> &req,
+            Callback<MultiResponse<ArithmeticResponse>> cb) {
+            conn.arithmetic(req, std::move(cb), stream);
+        });
 }
 
 void Client::http(ConnectionPtr connection, HttpRequest request,
     Callback<HttpResponse> callback)
 {
-    m_executor->add([
+    // HTTP requests are not bound to a key, so a sharded connection
+    // always sends them via its first shard
+    if (!connection->shards().empty())
+        connection = connection->shards().front();
+
+    auto eventBase = connection->eventBase();
+    eventBase->runInEventBaseThread([
         connection = std::move(connection), request = std::move(request),
         callback = std::move(callback)
     ] { connection->http(request, std::move(callback)); });
 }
 
-void Client::durability(ConnectionPtr connection,
+lcb_error_t Client::durability(ConnectionPtr connection,
     MultiRequest<DurabilityRequest> request, DurabilityRequestOptions options,
-    Callback<MultiResponse<DurabilityResponse>> callback)
+    Callback<MultiResponse<DurabilityResponse>> callback,
+    StreamPtr<DurabilityResponse> stream)
 {
-    m_executor->add([
-        connection = std::move(connection), request = std::move(request),
-        options = std::move(options), callback = std::move(callback)
-    ] {
-        connection->durability(
-            request, std::move(options), std::move(callback));
-    });
+    return admit(std::move(connection), std::move(request), std::move(callback),
+        [options = std::move(options), stream = std::move(stream)](
+            Connection &conn, const MultiRequest<DurabilityRequest> &req,
+            Callback<MultiResponse<DurabilityResponse>> cb) {
+            conn.durability(req, options, std::move(cb), stream);
+        });
 }
 
 } // namespace cb
@@ -18,6 +18,7 @@
 #include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -27,38 +28,90 @@ namespace cb {
 class Client {
 
 public:
-    Client();
+    /**
+     * Creates a client with an IO thread pool of @c workerCount threads.
+     * Each connection created by the client is pinned to the event base
+     * of one of these threads, picked in a round-robin fashion.
+     */
+    Client(unsigned short workerCount = 1);
 
     ~Client();
 
     void connect(ConnectRequest, Callback<ConnectResponse> callback);
 
-    void get(ConnectionPtr connection, MultiRequest<GetRequest> request,
-        Callback<MultiResponse<GetResponse>> callback);
-
-    void store(ConnectionPtr connection, MultiRequest<StoreRequest> request,
-        Callback<MultiResponse<StoreResponse>> callback);
-
-    void remove(ConnectionPtr connection, MultiRequest<RemoveRequest> request,
-        Callback<MultiResponse<RemoveResponse>> callback);
-
-    void arithmetic(ConnectionPtr connection,
+    /**
+     * Multi-key operations deliver their responses through @c callback
+     * at once or, when given a @c stream, in chunks through the stream
+     * followed by @c callback with the remaining responses. They return
+     * @c LCB_EBUSY, without calling @c callback, if the request is over
+     * the in-flight limit of the connection and is not to be queued.
+     */
+    lcb_error_t get(ConnectionPtr connection,
+        MultiRequest<GetRequest> request,
+        Callback<MultiResponse<GetResponse>> callback,
+        StreamPtr<GetResponse> stream = nullptr);
+
+    lcb_error_t store(ConnectionPtr connection,
+        MultiRequest<StoreRequest> request,
+        Callback<MultiResponse<StoreResponse>> callback,
+        StreamPtr<StoreResponse> stream = nullptr);
+
+    lcb_error_t remove(ConnectionPtr connection,
+        MultiRequest<RemoveRequest> request,
+        Callback<MultiResponse<RemoveResponse>> callback,
+        StreamPtr<RemoveResponse> stream = nullptr);
+
+    lcb_error_t arithmetic(ConnectionPtr connection,
         MultiRequest<ArithmeticRequest> request,
-        Callback<MultiResponse<ArithmeticResponse>> callback);
+        Callback<MultiResponse<ArithmeticResponse>> callback,
+        StreamPtr<ArithmeticResponse> stream = nullptr);
 
     void http(ConnectionPtr connection, HttpRequest request,
         Callback<HttpResponse> callback);
 
-    void durability(ConnectionPtr connection,
+    lcb_error_t durability(ConnectionPtr connection,
         MultiRequest<DurabilityRequest> request,
         DurabilityRequestOptions options,
-        Callback<MultiResponse<DurabilityResponse>> callback);
+        Callback<MultiResponse<DurabilityResponse>> callback,
+        StreamPtr<DurabilityResponse> stream = nullptr);
 
 private:
+    void connectInstance(
+        ConnectRequest request, Callback<ConnectResponse> callback);
+
+    void connectSharded(
+        ConnectRequest request, Callback<ConnectResponse> callback);
+
+    /**
+     * Admits the request to the in-flight limit of the connection and
+     * dispatches it, at once or once the limit allows. Batches dropped
+     * as their caller no longer waited are counted by the connection.
+     */
+    template <class RequestT, class ResponseT, class SubmitT>
+    lcb_error_t admit(ConnectionPtr connection,
+        MultiRequest<RequestT> request,
+        Callback<MultiResponse<ResponseT>> callback, SubmitT submit);
+
+    /**
+     * Runs @c submit on the event base of the connection or, for sharded
+     * connections, splits the request by key and runs @c submit on each
+     * shard, merging the shard responses into a single response.
+     */
+    template <class RequestT, class ResponseT, class SubmitT>
+    void dispatch(ConnectionPtr connection, MultiRequest<RequestT> request,
+        Callback<MultiResponse<ResponseT>> callback, SubmitT submit);
+
+    /**
+     * Releases a connection of the client before the client is destroyed.
+     * Its instance is destroyed on its event base.
+     */
+    void disconnect(ConnectionPtr connection);
+
     // Currently the connection created via a @c client instance
     // will be released only after the client event loop is
     // completed and client is destroyed
     std::vector<std::shared_ptr<cb::Connection>> m_connections;
+    std::mutex m_connectionsMutex;
 
     const unsigned short m_workerCount;
 
@@ -6,178 +6,502 @@
  */
 #include "connection.h"
 
+#include <chrono>
+#include <cstdint>
+
 namespace {
 
-void bootstrapCallback(lcb_t instance, lcb_error_t err)
+template <class TRes>
+typename cb::ResponsePlaceholder<TRes>::Batch *toBatch(const void *cookie)
+{
+    return static_cast<typename cb::ResponsePlaceholder<TRes>::Batch *>(
+        const_cast<void *>(cookie));
+}
+
+cb::Connection *toConnection(lcb_t instance)
 {
-    auto connection = const_cast<cb::Connection *>(
+    return const_cast<cb::Connection *>(
         static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
+}
+
+void bootstrapCallback(lcb_t instance, lcb_error_t err)
+{
+    auto connection = toConnection(instance);
 
     assert(connection);
     if (!connection)
         return;
 
-    auto responseId = connection->connectionId();
-    auto connectionPlaceholder =
-        dynamic_cast<cb::ConnectionResponses *>(connection);
-
-    if (!connectionPlaceholder->hasResponse(responseId))
-        return;
+    connection->bootstrapped(err);
+}
 
-    if (err == LCB_ETIMEDOUT) {
-        // With large number of connections, this callback receives sometimes
-        // one or more calls with timeout error, eventually followed by
-        // successfull connection response.
-        connectionPlaceholder->getResponse(responseId).setError(err);
-        if (!connection->retry()) {
-            connectionPlaceholder->emitResponse(responseId);
-            connectionPlaceholder->forgetResponse(responseId);
+/**
+ * Schedules all commands of the request with a single batch as their
+ * cookie. Commands rejected by libcouchbase are completed immediately
+ * with the error instead of failing the whole batch, as other batches
+ * may have commands scheduled in the same context.
+ */
+template <class RequestT, class TRes>
+void scheduleCommands(lcb_t instance, const cb::MultiRequest<RequestT> &request,
+    typename cb::ResponsePlaceholder<TRes>::Batch *batch,
+    lcb_error_t (*scheduleCommand)(
+        lcb_t, const void *, const typename RequestT::Command *))
+{
+    auto &response = batch->response();
+    for (std::size_t i = 0; i < request.size(); ++i) {
+        const auto &command = request.commands()[i];
+        auto err = scheduleCommand(instance, batch, &command);
+        if (err != LCB_SUCCESS) {
+            response.add(
+                err, command.key.contig.bytes, command.key.contig.nbytes);
         }
     }
-    else {
-        connectionPlaceholder->getResponse(responseId).setError(err);
-        connectionPlaceholder->emitResponse(responseId);
-        connectionPlaceholder->forgetResponse(responseId);
+
+    if (response.complete()) {
+        batch->complete();
     }
 }
 
-void getCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_get_resp_t *resp)
+/**
+ * Hands the responses of a streamed batch over every stream interval,
+ * until the batch is completed. The timer only keeps the id of the
+ * batch, so a completed batch is never touched.
+ */
+template <class TRes>
+void flushPeriodically(std::shared_ptr<cb::Connection> connection,
+    cb::ResponsePlaceholder<TRes> &responses, uint64_t id,
+    std::chrono::milliseconds interval)
 {
-    auto connection = const_cast<cb::Connection *>(
-        static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
+    connection->eventBase()->runAfterDelay(
+        [connection, &responses, id, interval] {
+            if (!responses.hasResponse(id))
+                return;
+
+            responses.getResponse(id).flush();
+            flushPeriodically(connection, responses, id, interval);
+        },
+        interval.count());
+}
 
-    assert(connection);
-    if (!connection)
+template <class TRes>
+void startStream(std::shared_ptr<cb::Connection> connection,
+    cb::ResponsePlaceholder<TRes> &responses,
+    typename cb::ResponsePlaceholder<TRes>::Batch *batch)
+{
+    const auto &stream = batch->response().stream();
+    if (!stream || stream->interval.count() == 0)
         return;
 
-    auto responseId = reinterpret_cast<const uint64_t>(cookie);
-    auto getPlaceholder = dynamic_cast<cb::GetResponses *>(connection);
-    if (!getPlaceholder->hasResponse(responseId))
-        return;
+    // Event base timers have a millisecond resolution
+    auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(
+        stream->interval + std::chrono::microseconds{999});
 
-    auto &response = getPlaceholder->getResponse(responseId);
+    flushPeriodically(
+        std::move(connection), responses, batch->id(), interval);
+}
 
-    if (err == LCB_SUCCESS) {
-        response.add(
-            cb::GetResponse{resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas,
-                resp->v.v0.flags, resp->v.v0.bytes, resp->v.v0.nbytes});
+/**
+ * Expires the batch once its caller no longer waits for it: at the
+ * deadline of its request, unless it has been completed by then, or with
+ * the first response after the caller is gone. A batch whose caller has
+ * given up already is expired and completed at once, in which case
+ * @c true is returned and its commands should not be scheduled.
+ */
+template <class TReq, class TRes>
+bool watchCaller(cb::Connection &connection,
+    const cb::MultiRequest<TReq> &request,
+    cb::ResponsePlaceholder<TRes> &responses,
+    typename cb::ResponsePlaceholder<TRes>::Batch *batch)
+{
+    const auto &abandoned = request.abandoned();
+    if (abandoned && abandoned->load(std::memory_order_relaxed)) {
+        batch->response().expire();
+        batch->complete();
+        return true;
     }
-    else {
-        response.add(cb::GetResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+
+    batch->response().setAbandoned(abandoned);
+
+    auto deadline = request.deadline();
+    if (deadline == std::chrono::steady_clock::time_point::max())
+        return false;
+
+    if (deadline <= std::chrono::steady_clock::now()) {
+        batch->response().expire();
+        batch->complete();
+        return true;
     }
 
-    if (response.complete()) {
-        getPlaceholder->emitResponse(responseId);
-        getPlaceholder->forgetResponse(responseId);
+    connection.expireAt(deadline, [&responses, id = batch->id()](bool expire) {
+        if (!responses.hasResponse(id))
+            return false;
+
+        if (expire)
+            responses.getResponse(id).expire();
+
+        return true;
+    });
+
+    return false;
+}
+
+using GetBatch = cb::GetResponses::Batch;
+
+// Gets shared by several batches are sent with the pointer to the batch
+// that has sent them tagged in its lowest bit, which is always clear as
+// batches are aligned
+const void *sharedCookie(const void *cookie)
+{
+    return reinterpret_cast<const void *>(
+        reinterpret_cast<std::uintptr_t>(cookie) | 1);
+}
+
+bool isShared(const void *cookie)
+{
+    return reinterpret_cast<std::uintptr_t>(cookie) & 1;
+}
+
+GetBatch *toGetBatch(const void *cookie)
+{
+    return reinterpret_cast<GetBatch *>(
+        reinterpret_cast<std::uintptr_t>(cookie) & ~std::uintptr_t{1});
+}
+
+// Hedged gets are sent with the pointer to their read tagged in the
+// second lowest bit, the read keeping the cookie of the get
+const void *hedgedCookie(const cb::HedgedRead *read)
+{
+    return reinterpret_cast<const void *>(
+        reinterpret_cast<std::uintptr_t>(read) | 2);
+}
+
+bool isHedged(const void *cookie)
+{
+    return reinterpret_cast<std::uintptr_t>(cookie) & 2;
+}
+
+cb::HedgedRead *toHedgedRead(const void *cookie)
+{
+    return reinterpret_cast<cb::HedgedRead *>(
+        reinterpret_cast<std::uintptr_t>(cookie) & ~std::uintptr_t{2});
+}
+
+/**
+ * Sends a plain get, hedged if the connection hedges reads.
+ */
+lcb_error_t sendGet(lcb_t instance, const void *cookie, folly::StringPiece key,
+    const lcb_CMDGET *command)
+{
+    auto connection = toConnection(instance);
+    auto reads = connection->hedgedReads();
+    if (!reads)
+        return lcb_get3(instance, cookie, command);
+
+    auto read = reads->start(cookie, key);
+    auto err = lcb_get3(instance, hedgedCookie(read), command);
+    if (err != LCB_SUCCESS) {
+        // The read is deleted once it leaves the queue
+        read->getDone = true;
+        read->answered = true;
     }
+
+    connection->hedge();
+    return err;
 }
 
-void storeCallback(lcb_t instance, const void *cookie, lcb_storage_t operation,
-    lcb_error_t err, const lcb_store_resp_t *resp)
+/**
+ * Schedules a get, unless it can be served from the near cache of the
+ * connection, the key is known to be absent or the get can wait for a
+ * get of the same key already in flight. Gets that touch or lock the
+ * document are always sent on their own, and drop its cached entry.
+ */
+lcb_error_t scheduleGet(
+    lcb_t instance, const void *cookie, const lcb_CMDGET *command)
 {
-    auto connection = const_cast<cb::Connection *>(
-        static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
+    auto connection = toConnection(instance);
+    auto cache = connection->nearCache();
+    auto absent = connection->negativeCache();
+    auto flights = connection->getFlights();
+
+    folly::StringPiece key{
+        static_cast<const char *>(command->key.contig.bytes),
+        command->key.contig.nbytes};
+
+    if (command->exptime != 0 || command->lock) {
+        if (cache)
+            cache->invalidate(key);
+        return lcb_get3(instance, cookie, command);
+    }
 
-    assert(connection);
-    if (!connection)
-        return;
+    auto batch = toGetBatch(cookie);
 
-    auto responseId = reinterpret_cast<const uint64_t>(cookie);
-    auto storePlaceholder = dynamic_cast<cb::StoreResponses *>(connection);
-    if (!storePlaceholder->hasResponse(responseId))
-        return;
+    if (cache) {
+        if (auto entry = cache->find(key)) {
+            batch->response().add(key.data(), key.size(), entry->cas,
+                entry->flags, entry->value.data(), entry->value.size(),
+                connection->decodesJson());
+            return LCB_SUCCESS;
+        }
+    }
 
-    auto &response = storePlaceholder->getResponse(responseId);
+    // Drops fills registered by the lookups above for a get not sent
+    auto cancelFills = [&] {
+        if (cache)
+            cache->cancelFill(key);
+        if (absent)
+            absent->cancelFill(key);
+    };
+
+    if (absent && absent->absent(key)) {
+        if (cache)
+            cache->cancelFill(key);
+        batch->response().add(LCB_KEY_ENOENT, key.data(), key.size());
+        return LCB_SUCCESS;
+    }
 
-    if (err == LCB_SUCCESS) {
-        response.add(
-            cb::StoreResponse{resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas});
+    if (flights && flights->join(key, batch)) {
+        // Only the get in flight fills the caches
+        batch->retain();
+        cancelFills();
+        return LCB_SUCCESS;
+    }
+
+    auto err = sendGet(
+        instance, flights ? sharedCookie(cookie) : cookie, key, command);
+    if (err != LCB_SUCCESS) {
+        if (flights)
+            flights->land(key);
+        cancelFills();
+    }
+
+    return err;
+}
+
+/**
+ * Drops the cached entry of a key mutated through the connection. This
+ * is done whatever the outcome, as a failed mutation, e.g. with a CAS
+ * mismatch, may reveal that the entry is stale.
+ */
+void invalidateCached(lcb_t instance, const lcb_RESPBASE *resp)
+{
+    if (auto cache = toConnection(instance)->nearCache()) {
+        cache->invalidate(
+            {static_cast<const char *>(resp->key), resp->nkey});
+    }
+}
+
+/**
+ * Forgets that a key stored or incremented through the connection is
+ * absent. As with the near cache, this is done whatever the outcome.
+ */
+void invalidateAbsent(lcb_t instance, const lcb_RESPBASE *resp)
+{
+    if (auto absent = toConnection(instance)->negativeCache()) {
+        absent->invalidate(
+            {static_cast<const char *>(resp->key), resp->nkey});
+    }
+}
+
+// Values at least this large are passed to Erlang in the libcouchbase
+// packet buffer instead of being copied
+constexpr std::size_t kRetainedValueSize = 4096;
+
+void addGetResponse(GetBatch *batch, const lcb_RESPGET *resp,
+    const cb::BufferPtr &buffer, bool decodeJson, bool replica)
+{
+    auto &response = batch->response();
+
+    if (resp->rc != LCB_SUCCESS) {
+        response.add(resp->rc, resp->key, resp->nkey);
+    }
+    else if (buffer) {
+        response.add(resp->key, resp->nkey, resp->cas, resp->itmflags,
+            resp->value, resp->nvalue, buffer, replica);
     }
     else {
-        response.add(cb::StoreResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+        response.add(resp->key, resp->nkey, resp->cas, resp->itmflags,
+            resp->value, resp->nvalue, decodeJson, replica);
     }
 
     if (response.complete()) {
-        storePlaceholder->emitResponse(responseId);
-        storePlaceholder->forgetResponse(responseId);
+        batch->complete();
     }
 }
 
-void arithmeticCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_arithmetic_resp_t *resp)
+/**
+ * Answers a get sent with the cookie, and gets that have joined it.
+ * Values read from a replica may be stale, so they are not cached.
+ */
+void answerGet(cb::Connection *connection, const void *cookie,
+    const lcb_RESPGET *resp, bool replica)
 {
-    auto connection = const_cast<cb::Connection *>(
-        static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
+    folly::StringPiece key{static_cast<const char *>(resp->key), resp->nkey};
+
+    // Decoded JSON values are converted to terms, so there is no point
+    // in retaining their buffers
+    auto decodeJson =
+        connection->decodesJson() && resp->itmflags == cb::kJsonFlags;
+
+    cb::BufferPtr buffer;
+    if (resp->rc == LCB_SUCCESS && !decodeJson &&
+        connection->retainsBuffers() && resp->bufh &&
+        resp->nvalue >= kRetainedValueSize) {
+        buffer =
+            connection->retainBuffer(static_cast<lcb_BACKBUF>(resp->bufh));
+    }
 
-    assert(connection);
-    if (!connection)
-        return;
+    if (auto cache = connection->nearCache()) {
+        if (resp->rc == LCB_SUCCESS && !replica) {
+            cache->fill(key,
+                {static_cast<const char *>(resp->value), resp->nvalue},
+                resp->itmflags, resp->cas);
+        }
+        else {
+            cache->cancelFill(key);
+        }
+    }
 
-    auto responseId = reinterpret_cast<const uint64_t>(cookie);
-    auto arithmeticPlaceholder =
-        dynamic_cast<cb::ArithmeticResponses *>(connection);
-    if (!arithmeticPlaceholder->hasResponse(responseId))
+    if (auto absent = connection->negativeCache()) {
+        if (resp->rc == LCB_KEY_ENOENT)
+            absent->fill(key);
+        else
+            absent->cancelFill(key);
+    }
+
+    std::vector<GetBatch *> waiters;
+    if (isShared(cookie)) {
+        waiters = connection->getFlights()->land(key);
+    }
+
+    addGetResponse(toGetBatch(cookie), resp, buffer, decodeJson, replica);
+    for (auto waiter : waiters) {
+        addGetResponse(waiter, resp, buffer, decodeJson, replica);
+        waiter->release();
+    }
+}
+
+/**
+ * Answers a get, unless it has been hedged and the replica read has
+ * answered first. Errors other than a missing key are held back while
+ * the replica read is in flight, as it may still succeed.
+ */
+void getCallback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    auto resp = reinterpret_cast<const lcb_RESPGET *>(rb);
+    auto connection = toConnection(instance);
+
+    if (!isHedged(resp->cookie)) {
+        answerGet(connection, resp->cookie, resp, false);
         return;
+    }
 
-    auto &response = arithmeticPlaceholder->getResponse(responseId);
+    auto read = toHedgedRead(resp->cookie);
+    read->getDone = true;
 
-    if (err == LCB_SUCCESS) {
-        response.add(cb::ArithmeticResponse{
-            resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas, resp->v.v0.value});
+    if (!read->answered) {
+        if (resp->rc == LCB_SUCCESS || resp->rc == LCB_KEY_ENOENT ||
+            !read->replicaSent || read->replicaDone) {
+            read->answered = true;
+            answerGet(connection, read->cookie, resp, false);
+        }
+        else {
+            read->err = resp->rc;
+        }
+    }
+
+    connection->hedgedReads()->finish(read);
+}
+
+/**
+ * Answers a hedged get with the value read from a replica, unless the
+ * get has answered first. If the replica read fails after the get has,
+ * the get is answered with its own error.
+ */
+void getReplicaCallback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    auto resp = reinterpret_cast<const lcb_RESPGET *>(rb);
+    auto connection = toConnection(instance);
+    auto read = static_cast<cb::HedgedRead *>(resp->cookie);
+    read->replicaDone = true;
+
+    if (!read->answered) {
+        if (resp->rc == LCB_SUCCESS) {
+            read->answered = true;
+            connection->hedgedReads()->countReplicaAnswer();
+            answerGet(connection, read->cookie, resp, true);
+        }
+        else if (read->getDone) {
+            read->answered = true;
+            auto failed = *resp;
+            failed.rc = read->err;
+            answerGet(connection, read->cookie, &failed, false);
+        }
+    }
+
+    connection->hedgedReads()->finish(read);
+}
+
+void storeCallback(lcb_t instance, int cbtype, const lcb_RESPBASE *resp)
+{
+    invalidateCached(instance, resp);
+    invalidateAbsent(instance, resp);
+
+    auto batch = toBatch<cb::MultiResponse<cb::StoreResponse>>(resp->cookie);
+    auto &response = batch->response();
+
+    if (resp->rc == LCB_SUCCESS) {
+        response.add(resp->key, resp->nkey, resp->cas);
     }
     else {
-        response.add(
-            cb::ArithmeticResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+        response.add(resp->rc, resp->key, resp->nkey);
     }
 
     if (response.complete()) {
-        arithmeticPlaceholder->emitResponse(responseId);
-        arithmeticPlaceholder->forgetResponse(responseId);
+        batch->complete();
     }
 }
 
-void removeCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_remove_resp_t *resp)
+void arithmeticCallback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    auto connection = const_cast<cb::Connection *>(
-        static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
+    invalidateCached(instance, rb);
+    invalidateAbsent(instance, rb);
 
-    assert(connection);
-    if (!connection)
-        return;
+    auto resp = reinterpret_cast<const lcb_RESPCOUNTER *>(rb);
+    auto batch =
+        toBatch<cb::MultiResponse<cb::ArithmeticResponse>>(resp->cookie);
+    auto &response = batch->response();
 
-    auto responseId = reinterpret_cast<const uint64_t>(cookie);
-    auto removePlaceholder = dynamic_cast<cb::RemoveResponses *>(connection);
-    if (!removePlaceholder->hasResponse(responseId))
-        return;
+    if (resp->rc == LCB_SUCCESS) {
+        response.add(resp->key, resp->nkey, resp->cas, resp->value);
+    }
+    else {
+        response.add(resp->rc, resp->key, resp->nkey);
+    }
+
+    if (response.complete()) {
+        batch->complete();
+    }
+}
+
+void removeCallback(lcb_t instance, int cbtype, const lcb_RESPBASE *resp)
+{
+    invalidateCached(instance, resp);
 
-    auto &response = removePlaceholder->getResponse(responseId);
+    auto batch = toBatch<cb::MultiResponse<cb::RemoveResponse>>(resp->cookie);
+    auto &response = batch->response();
 
-    response.add(cb::RemoveResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+    response.add(resp->rc, resp->key, resp->nkey);
 
     if (response.complete()) {
-        removePlaceholder->emitResponse(responseId);
-        removePlaceholder->forgetResponse(responseId);
+        batch->complete();
     }
 }
 
 void httpCallback(lcb_http_request_t request, lcb_t instance,
     const void *cookie, lcb_error_t err, const lcb_http_resp_t *resp)
 {
-    auto connection = const_cast<cb::Connection *>(
-        static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
-
-    assert(connection);
-    if (!connection)
-        return;
-
-    auto responseId = reinterpret_cast<const uint64_t>(cookie);
-    auto httpPlaceholder = dynamic_cast<cb::HttpResponses *>(connection);
-    if (!httpPlaceholder->hasResponse(responseId))
-        return;
-
-    auto &response = httpPlaceholder->getResponse(responseId);
+    auto batch = toBatch<cb::HttpResponse>(cookie);
+    auto &response = batch->response();
 
     response.setError(err);
     if (err == LCB_SUCCESS) {
@@ -185,40 +509,24 @@ void httpCallback(lcb_http_request_t request, lcb_t instance,
         response.setBody(resp->v.v0.bytes, resp->v.v0.nbytes);
     }
 
-    httpPlaceholder->emitResponse(responseId);
-    httpPlaceholder->forgetResponse(responseId);
+    batch->complete();
 }
 
-void durabilityCallback(lcb_t instance, const void *cookie, lcb_error_t err,
-    const lcb_durability_resp_t *resp)
+void durabilityCallback(lcb_t instance, int cbtype, const lcb_RESPBASE *resp)
 {
-    auto connection = const_cast<cb::Connection *>(
-        static_cast<const cb::Connection *>(lcb_get_cookie(instance)));
-
-    assert(connection);
-    if (!connection)
-        return;
-
-    auto responseId = reinterpret_cast<const uint64_t>(cookie);
-    auto durabilityPlaceholder =
-        dynamic_cast<cb::DurabilityResponses *>(connection);
-    if (!durabilityPlaceholder->hasResponse(responseId))
-        return;
-
-    auto &response = durabilityPlaceholder->getResponse(responseId);
+    auto batch =
+        toBatch<cb::MultiResponse<cb::DurabilityResponse>>(resp->cookie);
+    auto &response = batch->response();
 
-    if (err == LCB_SUCCESS) {
-        response.add(cb::DurabilityResponse{
-            resp->v.v0.key, resp->v.v0.nkey, resp->v.v0.cas});
+    if (resp->rc == LCB_SUCCESS) {
+        response.add(resp->key, resp->nkey, resp->cas);
     }
     else {
-        response.add(
-            cb::DurabilityResponse{err, resp->v.v0.key, resp->v.v0.nkey});
+        response.add(resp->rc, resp->key, resp->nkey);
     }
 
     if (response.complete()) {
-        durabilityPlaceholder->emitResponse(responseId);
-        durabilityPlaceholder->forgetResponse(responseId);
+        batch->complete();
     }
 }
 } // namespace
@@ -236,6 +544,185 @@ Connection::Connection()
 
 uint64_t Connection::connectionId() const { return m_connectionId; }
 
+folly::EventBase *Connection::eventBase() const { return m_eventBase; }
+
+bool Connection::decodesJson() const { return m_decodeJson; }
+
+bool Connection::retainsBuffers() const { return m_retainBuffers; }
+
+NearCache *Connection::nearCache() const { return m_nearCache.get(); }
+
+NegativeCache *Connection::negativeCache() const
+{
+    return m_negativeCache.get();
+}
+
+void Connection::expireAt(
+    std::chrono::steady_clock::time_point deadline, Deadlines::Batch batch)
+{
+    m_deadlines.add(deadline, std::move(batch));
+    armDeadlines();
+}
+
+void Connection::armDeadlines()
+{
+    auto wait = m_deadlines.arm();
+    if (!wait)
+        return;
+
+    // The timer does not keep the connection alive until the deadline
+    m_eventBase->runAfterDelay(
+        [
+            connection = std::weak_ptr<Connection>{shared_from_this()},
+            generation = m_deadlines.generation()
+        ] {
+            auto self = connection.lock();
+            if (self && self->m_deadlines.expireDue(generation))
+                self->armDeadlines();
+        },
+        wait->count());
+}
+
+SingleFlight<GetResponses::Batch *> *Connection::getFlights() const
+{
+    return m_getFlights.get();
+}
+
+HedgedReads *Connection::hedgedReads() const { return m_hedgedReads.get(); }
+
+void Connection::hedge()
+{
+    auto wait = m_hedgedReads->arm();
+    if (!wait)
+        return;
+
+    m_eventBase->runAfterDelay(
+        [self = shared_from_this()] {
+            auto reads = self->m_hedgedReads.get();
+            reads->disarm();
+
+            auto due = reads->takeDue();
+            if (!due.empty())
+                self->schedule();
+
+            for (auto read : due) {
+                lcb_CMDGETREPLICA command = {0};
+                LCB_CMD_SET_KEY(&command, read->key.data(), read->key.size());
+                command.strategy = LCB_REPLICA_FIRST;
+
+                // The get is left to answer on its own if the replica
+                // read cannot be sent, e.g. as there are no replicas
+                read->replicaSent =
+                    lcb_rget3(self->m_instance, read, &command) ==
+                    LCB_SUCCESS;
+                reads->finish(read);
+            }
+
+            self->hedge();
+        },
+        wait->count());
+}
+
+NearCache::Stats Connection::nearCacheStats() const
+{
+    NearCache::Stats stats;
+    if (m_nearCache)
+        stats = m_nearCache->stats();
+
+    for (const auto &shard : m_shards) {
+        auto shardStats = shard->nearCacheStats();
+        stats.hits += shardStats.hits;
+        stats.misses += shardStats.misses;
+    }
+
+    return stats;
+}
+
+NegativeCache::Stats Connection::negativeCacheStats() const
+{
+    NegativeCache::Stats stats;
+    if (m_negativeCache)
+        stats = m_negativeCache->stats();
+
+    for (const auto &shard : m_shards) {
+        auto shardStats = shard->negativeCacheStats();
+        stats.hits += shardStats.hits;
+        stats.misses += shardStats.misses;
+    }
+
+    return stats;
+}
+
+HedgedReads::Stats Connection::hedgedReadStats() const
+{
+    HedgedReads::Stats stats;
+    if (m_hedgedReads)
+        stats = m_hedgedReads->stats();
+
+    for (const auto &shard : m_shards) {
+        auto shardStats = shard->hedgedReadStats();
+        stats.hedged += shardStats.hedged;
+        stats.replicaAnswers += shardStats.replicaAnswers;
+    }
+
+    return stats;
+}
+
+SingleFlight<GetResponses::Batch *>::Stats
+Connection::singleFlightStats() const
+{
+    SingleFlight<GetResponses::Batch *>::Stats stats;
+    if (m_getFlights)
+        stats = m_getFlights->stats();
+
+    for (const auto &shard : m_shards) {
+        auto shardStats = shard->singleFlightStats();
+        stats.flights += shardStats.flights;
+        stats.joins += shardStats.joins;
+    }
+
+    return stats;
+}
+
+std::size_t Connection::retainedBuffers() const
+{
+    auto retained = m_buffers->retained();
+    for (const auto &shard : m_shards)
+        retained += shard->retainedBuffers();
+
+    return retained;
+}
+
+void Connection::countDropped()
+{
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t Connection::droppedBatches() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+InFlightLimit *Connection::inFlightLimit() const
+{
+    return m_inFlightLimit.get();
+}
+
+void Connection::setInFlightLimit(std::unique_ptr<InFlightLimit> limit)
+{
+    m_inFlightLimit = std::move(limit);
+}
+
+const std::vector<std::shared_ptr<Connection>> &Connection::shards() const
+{
+    return m_shards;
+}
+
+void Connection::setShards(std::vector<std::shared_ptr<Connection>> shards)
+{
+    m_shards = std::move(shards);
+}
+
 uint16_t Connection::retry()
 {
     if (--m_retriesLeft < 0)
@@ -246,6 +733,9 @@ uint16_t Connection::retry()
 void Connection::bootstrap(const ConnectRequest &request,
     folly::EventBase *eventBase, Callback<ConnectResponse> callback)
 {
+    m_eventBase = eventBase;
+    m_buffers->setEventBase(eventBase);
+
     struct lcb_create_st createOpts = {0};
     createOpts.v.v0.host = request.host().c_str();
     createOpts.v.v0.user = request.username().c_str();
@@ -270,12 +760,24 @@ void Connection::bootstrap(const ConnectRequest &request,
     lcb_set_cookie(m_instance, this);
 
     lcb_set_bootstrap_callback(m_instance, bootstrapCallback);
-    lcb_set_get_callback(m_instance, getCallback);
-    lcb_set_store_callback(m_instance, storeCallback);
-    lcb_set_arithmetic_callback(m_instance, arithmeticCallback);
-    lcb_set_remove_callback(m_instance, removeCallback);
+    lcb_install_callback3(m_instance, LCB_CALLBACK_GET, getCallback);
+    lcb_install_callback3(
+        m_instance, LCB_CALLBACK_GETREPLICA, getReplicaCallback);
+    lcb_install_callback3(m_instance, LCB_CALLBACK_STORE, storeCallback);
+    lcb_install_callback3(
+        m_instance, LCB_CALLBACK_COUNTER, arithmeticCallback);
+    lcb_install_callback3(m_instance, LCB_CALLBACK_REMOVE, removeCallback);
+    lcb_install_callback3(
+        m_instance, LCB_CALLBACK_ENDURE, durabilityCallback);
     lcb_set_http_complete_callback(m_instance, httpCallback);
-    lcb_set_durability_callback(m_instance, durabilityCallback);
+
+    bool singleFlight = true;
+    std::size_t nearCacheSize = 0;
+    std::chrono::milliseconds nearCacheTtl{1000};
+    std::size_t negativeCacheSize = 0;
+    std::chrono::milliseconds negativeCacheTtl{1000};
+    // Reads are not hedged unless a delay is given, 0 hedges them at once
+    std::chrono::milliseconds hedgedReadDelay{-1};
 
     std::string optName;
     int optValue;
@@ -305,158 +807,204 @@ void Connection::bootstrap(const ConnectRequest &request,
             err = lcb_cntl(
                 m_instance, LCB_CNTL_SET, LCB_CNTL_HTTP_TIMEOUT, &optValue);
         }
+        else if (optName == "compression") {
+            err = lcb_cntl(m_instance, LCB_CNTL_SET,
+                LCB_CNTL_COMPRESSION_OPTS, &optValue);
+        }
+        else if (optName == "compression_min_size") {
+#if defined(LCB_CNTL_COMPRESSION_MIN_SIZE)
+            lcb_U32 minSize = optValue;
+            err = lcb_cntl(m_instance, LCB_CNTL_SET,
+                LCB_CNTL_COMPRESSION_MIN_SIZE, &minSize);
+#else
+            err = LCB_NOT_SUPPORTED;
+#endif
+        }
+        else if (optName == "native_json") {
+            m_decodeJson = optValue != 0;
+        }
+        else if (optName == "single_flight") {
+            singleFlight = optValue != 0;
+        }
+        else if (optName == "near_cache_size") {
+            nearCacheSize = optValue;
+        }
+        else if (optName == "near_cache_ttl") {
+            nearCacheTtl = std::chrono::milliseconds{optValue};
+        }
+        else if (optName == "negative_cache_size") {
+            negativeCacheSize = optValue;
+        }
+        else if (optName == "negative_cache_ttl") {
+            negativeCacheTtl = std::chrono::milliseconds{optValue};
+        }
+        else if (optName == "hedged_read_delay") {
+            hedgedReadDelay = std::chrono::milliseconds{optValue};
+        }
         if (err != LCB_SUCCESS) {
             throw err;
         }
     }
 
+    // Inflated values live in a buffer freed by libcouchbase after the
+    // get callback, while the packet buffer holds the compressed value
+    int compression = 0;
+    err = lcb_cntl(
+        m_instance, LCB_CNTL_GET, LCB_CNTL_COMPRESSION_OPTS, &compression);
+    m_retainBuffers =
+        err == LCB_SUCCESS && !(compression & LCB_COMPRESS_IN);
+
+    if (singleFlight) {
+        m_getFlights = std::make_unique<SingleFlight<GetResponses::Batch *>>();
+    }
+
+    if (hedgedReadDelay.count() >= 0) {
+        m_hedgedReads = std::make_unique<HedgedReads>(hedgedReadDelay);
+    }
+
+    if (nearCacheSize > 0) {
+        m_nearCache =
+            std::make_unique<NearCache>(nearCacheSize, nearCacheTtl);
+    }
+
+    if (negativeCacheSize > 0) {
+        m_negativeCache = std::make_unique<NegativeCache>(
+            negativeCacheSize, negativeCacheTtl);
+    }
+
     cb::ConnectResponse response{LCB_SUCCESS, getShared()};
 
-    ConnectionResponses::storeResponse(
-        connectionId(), std::move(response), std::move(callback));
+    m_bootstrapId = m_connectResponses.storeResponse(
+        std::move(response), std::move(callback));
 
     err = lcb_connect(m_instance);
     if (err != LCB_SUCCESS) {
-        ConnectionResponses::forgetResponse(connectionId());
+        m_connectResponses.forgetResponse(m_bootstrapId);
         throw err;
     }
 }
 
-Connection::~Connection() { lcb_destroy(m_instance); }
+void Connection::bootstrapped(lcb_error_t err)
+{
+    if (!m_connectResponses.hasResponse(m_bootstrapId))
+        return;
+
+    m_connectResponses.getResponse(m_bootstrapId).setError(err);
+
+    // With large number of connections, this callback receives sometimes
+    // one or more calls with timeout error, eventually followed by
+    // successfull connection response.
+    if (err == LCB_ETIMEDOUT && retry())
+        return;
+
+    m_connectResponses.completeResponse(m_bootstrapId);
+}
+
+BufferPtr Connection::retainBuffer(lcb_BACKBUF buffer)
+{
+    return m_buffers->retain(buffer);
+}
+
+Connection::~Connection()
+{
+    // Buffers still retained by Erlang outlive the instance
+    m_buffers->close(m_instance);
+}
+
+void Connection::schedule()
+{
+    if (m_scheduled)
+        return;
+
+    m_buffers->drain();
+
+    lcb_sched_enter(m_instance);
+    m_scheduled = true;
+
+    m_eventBase->runInLoop([self = shared_from_this()] {
+        self->m_scheduled = false;
+        lcb_sched_leave(self->m_instance);
+    });
+}
 
 void Connection::get(const MultiRequest<GetRequest> &request,
-    Callback<MultiResponse<GetResponse>> callback)
+    Callback<MultiResponse<GetResponse>> callback,
+    StreamPtr<GetResponse> stream)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_get_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.exptime = requests[i].expiry();
-        commands[i].v.v0.lock = requests[i].lock();
-    }
-    std::vector<const lcb_get_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
+    cb::MultiResponse<cb::GetResponse> response{
+        LCB_SUCCESS, request.size(), std::move(stream)};
 
-    cb::MultiResponse<cb::GetResponse> response{LCB_SUCCESS, requests.size()};
+    auto batch =
+        m_getResponses.storeBatch(std::move(response), std::move(callback));
 
-    auto requestId =
-        GetResponses::storeResponse(std::move(response), std::move(callback));
+    if (watchCaller(*this, request, m_getResponses, batch))
+        return;
 
-    auto err = lcb_get(m_instance, reinterpret_cast<void *>(requestId),
-        requests.size(), commandsPtr.data());
+    startStream(getShared(), m_getResponses, batch);
 
-    if (err != LCB_SUCCESS) {
-        GetResponses::getResponse(requestId).setError(err);
-        GetResponses::emitResponse(requestId);
-        GetResponses::forgetResponse(requestId);
-    }
+    schedule();
+    scheduleCommands<GetRequest, MultiResponse<GetResponse>>(
+        m_instance, request, batch, scheduleGet);
 }
 
 void Connection::store(const MultiRequest<StoreRequest> &request,
-    Callback<MultiResponse<StoreResponse>> callback)
+    Callback<MultiResponse<StoreResponse>> callback,
+    StreamPtr<StoreResponse> stream)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_store_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.operation = requests[i].operation();
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.cas = requests[i].cas();
-        commands[i].v.v0.flags = requests[i].flags();
-        commands[i].v.v0.bytes = requests[i].value().c_str();
-        commands[i].v.v0.nbytes = requests[i].value().size();
-        commands[i].v.v0.exptime = requests[i].expiry();
-    }
-    std::vector<const lcb_store_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
+    cb::MultiResponse<cb::StoreResponse> response{
+        LCB_SUCCESS, request.size(), std::move(stream)};
 
-    cb::MultiResponse<cb::StoreResponse> response{LCB_SUCCESS, requests.size()};
+    auto batch =
+        m_storeResponses.storeBatch(std::move(response), std::move(callback));
 
-    auto requestId =
-        StoreResponses::storeResponse(std::move(response), std::move(callback));
+    if (watchCaller(*this, request, m_storeResponses, batch))
+        return;
 
-    auto err = lcb_store(m_instance, reinterpret_cast<void *>(requestId),
-        requests.size(), commandsPtr.data());
+    startStream(getShared(), m_storeResponses, batch);
 
-    if (err != LCB_SUCCESS) {
-        StoreResponses::getResponse(requestId).setError(err);
-        StoreResponses::emitResponse(requestId);
-        StoreResponses::forgetResponse(requestId);
-    }
+    schedule();
+    scheduleCommands<StoreRequest, MultiResponse<StoreResponse>>(
+        m_instance, request, batch, lcb_store3);
 }
 
 void Connection::remove(const MultiRequest<RemoveRequest> &request,
-    Callback<MultiResponse<RemoveResponse>> callback)
+    Callback<MultiResponse<RemoveResponse>> callback,
+    StreamPtr<RemoveResponse> stream)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_remove_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.cas = requests[i].cas();
-    }
-    std::vector<const lcb_remove_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
-
     cb::MultiResponse<cb::RemoveResponse> response{
-        LCB_SUCCESS, requests.size()};
+        LCB_SUCCESS, request.size(), std::move(stream)};
 
-    auto requestId = RemoveResponses::storeResponse(
-        std::move(response), std::move(callback));
+    auto batch =
+        m_removeResponses.storeBatch(std::move(response), std::move(callback));
 
-    auto err = lcb_remove(m_instance, reinterpret_cast<void *>(requestId),
-        requests.size(), commandsPtr.data());
+    if (watchCaller(*this, request, m_removeResponses, batch))
+        return;
 
-    if (err != LCB_SUCCESS) {
-        RemoveResponses::getResponse(requestId).setError(err);
-        RemoveResponses::emitResponse(requestId);
-        RemoveResponses::forgetResponse(requestId);
-    }
+    startStream(getShared(), m_removeResponses, batch);
+
+    schedule();
+    scheduleCommands<RemoveRequest, MultiResponse<RemoveResponse>>(
+        m_instance, request, batch, lcb_remove3);
 }
 
 void Connection::arithmetic(const MultiRequest<ArithmeticRequest> &request,
-    Callback<MultiResponse<ArithmeticResponse>> callback)
+    Callback<MultiResponse<ArithmeticResponse>> callback,
+    StreamPtr<ArithmeticResponse> stream)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_arithmetic_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.delta = requests[i].delta();
-        commands[i].v.v0.create = requests[i].create();
-        commands[i].v.v0.initial = requests[i].initial();
-        commands[i].v.v0.exptime = requests[i].expiry();
-    }
-    std::vector<const lcb_arithmetic_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
-
     cb::MultiResponse<cb::ArithmeticResponse> response{
-        LCB_SUCCESS, requests.size()};
+        LCB_SUCCESS, request.size(), std::move(stream)};
 
-    auto requestId = ArithmeticResponses::storeResponse(
+    auto batch = m_arithmeticResponses.storeBatch(
         std::move(response), std::move(callback));
 
-    auto err = lcb_arithmetic(m_instance, reinterpret_cast<void *>(requestId),
-        requests.size(), commandsPtr.data());
+    if (watchCaller(*this, request, m_arithmeticResponses, batch))
+        return;
 
-    if (err != LCB_SUCCESS) {
-        ArithmeticResponses::getResponse(requestId).setError(err);
-        ArithmeticResponses::emitResponse(requestId);
-        ArithmeticResponses::forgetResponse(requestId);
-    }
+    startStream(getShared(), m_arithmeticResponses, batch);
+
+    schedule();
+    scheduleCommands<ArithmeticRequest, MultiResponse<ArithmeticResponse>>(
+        m_instance, request, batch, lcb_counter3);
 }
 
 void Connection::http(
@@ -475,55 +1023,69 @@ void Connection::http(
 
     cb::HttpResponse response{LCB_SUCCESS};
 
-    auto requestId =
-        HttpResponses::storeResponse(std::move(response), std::move(callback));
+    auto batch =
+        m_httpResponses.storeBatch(std::move(response), std::move(callback));
 
-    auto err = lcb_make_http_request(m_instance,
-        reinterpret_cast<void *>(requestId), request.type(), &command, &req);
+    auto err = lcb_make_http_request(
+        m_instance, batch, request.type(), &command, &req);
 
     if (err != LCB_SUCCESS) {
-        HttpResponses::getResponse(requestId).setError(err);
-        HttpResponses::emitResponse(requestId);
-        HttpResponses::forgetResponse(requestId);
+        batch->response().setError(err);
+        batch->complete();
     }
 }
 
 void Connection::durability(const MultiRequest<DurabilityRequest> &request,
     const DurabilityRequestOptions &requestOptions,
-    Callback<MultiResponse<DurabilityResponse>> callback)
+    Callback<MultiResponse<DurabilityResponse>> callback,
+    StreamPtr<DurabilityResponse> stream)
 {
-    const auto &requests = request.requests();
-    std::vector<lcb_durability_cmd_t> commands{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commands[i].version = 0;
-        commands[i].v.v0.key = requests[i].key().c_str();
-        commands[i].v.v0.nkey = requests[i].key().size();
-        commands[i].v.v0.cas = requests[i].cas();
-    }
-    std::vector<const lcb_durability_cmd_t *> commandsPtr{requests.size()};
-    for (unsigned int i = 0; i < requests.size(); ++i) {
-        commandsPtr[i] = &commands[i];
-    }
-
     lcb_durability_opts_t options = {};
     options.v.v0.persist_to = requestOptions.persistTo();
     options.v.v0.replicate_to = requestOptions.replicateTo();
     options.v.v0.cap_max = 1;
 
     cb::MultiResponse<cb::DurabilityResponse> response{
-        LCB_SUCCESS, requests.size()};
+        LCB_SUCCESS, request.size(), std::move(stream)};
 
-    auto requestId = DurabilityResponses::storeResponse(
+    auto batch = m_durabilityResponses.storeBatch(
         std::move(response), std::move(callback));
 
-    auto err =
-        lcb_durability_poll(m_instance, reinterpret_cast<void *>(requestId),
-            &options, requests.size(), commandsPtr.data());
+    if (watchCaller(*this, request, m_durabilityResponses, batch))
+        return;
+
+    startStream(getShared(), m_durabilityResponses, batch);
+
+    schedule();
+
+    lcb_error_t err = LCB_SUCCESS;
+    auto context = lcb_endure3_ctxnew(m_instance, &options, &err);
+    if (!context) {
+        batch->response().setError(err);
+        batch->complete();
+        return;
+    }
+
+    for (std::size_t i = 0; i < request.size(); ++i) {
+        const auto &command = request.commands()[i];
+        err = context->addcmd(
+            context, reinterpret_cast<const lcb_CMDBASE *>(&command));
+        if (err != LCB_SUCCESS) {
+            batch->response().add(
+                err, command.key.contig.bytes, command.key.contig.nbytes);
+        }
+    }
+
+    if (batch->response().complete()) {
+        context->fail(context);
+        batch->complete();
+        return;
+    }
 
+    err = context->done(context, batch);
     if (err != LCB_SUCCESS) {
-        DurabilityResponses::getResponse(requestId).setError(err);
-        DurabilityResponses::emitResponse(requestId);
-        DurabilityResponses::forgetResponse(requestId);
+        batch->response().setError(err);
+        batch->complete();
     }
 }
 
@@ -8,18 +8,28 @@
 #ifndef COUCHBASE_CONNECTION_H
 #define COUCHBASE_CONNECTION_H
 
+#include "deadlines.h"
+#include "hedgedReads.h"
+#include "inFlightLimit.h"
+#include "nearCache.h"
+#include "negativeCache.h"
 #include "requests/requests.h"
 #include "responsePlaceholder.h"
 #include "responses/responses.h"
+#include "retainedBuffers.h"
+#include "singleFlight.h"
 #include "types.h"
 
 #include <folly/executors/IOThreadPoolExecutor.h>
 #include <libcouchbase/couchbase.h>
 
+#include <atomic>
+#include <cstdint>
 #include <future>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace cb {
 
@@ -33,14 +43,7 @@ using HttpResponses = ResponsePlaceholder<HttpResponse>;
 using DurabilityResponses =
     ResponsePlaceholder<MultiResponse<DurabilityResponse>>;
 
-class Connection : public ConnectionResponses,
-                   public GetResponses,
-                   public StoreResponses,
-                   public RemoveResponses,
-                   public ArithmeticResponses,
-                   public HttpResponses,
-                   public DurabilityResponses,
-                   public std::enable_shared_from_this<Connection> {
+class Connection : public std::enable_shared_from_this<Connection> {
 public:
     Connection();
 
@@ -52,32 +55,219 @@ public:
 
     uint16_t retry();
 
+    /**
+     * Returns the event base the connection has been bootstrapped on.
+     * All operations on the connection must be run on this event base.
+     */
+    folly::EventBase *eventBase() const;
+
+    /**
+     * Checks whether JSON values are decoded on the IO thread, as
+     * requested with the 'native_json' option.
+     */
+    bool decodesJson() const;
+
+    /**
+     * Checks whether values can be passed to Erlang in the libcouchbase
+     * packet buffer, which is not the case when libcouchbase inflates
+     * them into a buffer of its own.
+     */
+    bool retainsBuffers() const;
+
+    /**
+     * Returns the near cache of the connection, or @c nullptr if it has
+     * not been enabled with the 'near_cache_size' option.
+     */
+    NearCache *nearCache() const;
+
+    /**
+     * Returns the cache of keys known to be absent, or @c nullptr if it
+     * has not been enabled with the 'negative_cache_size' option.
+     */
+    NegativeCache *negativeCache() const;
+
+    /**
+     * Returns gets in flight on the connection, which gets of the same
+     * keys can join, or @c nullptr if disabled with the 'single_flight'
+     * option.
+     */
+    SingleFlight<GetResponses::Batch *> *getFlights() const;
+
+    /**
+     * Returns hedged reads of the connection, or @c nullptr if they have
+     * not been enabled with the 'hedged_read_delay' option.
+     */
+    HedgedReads *hedgedReads() const;
+
+    /**
+     * Arms the timer sending hedged reads, which have not been answered
+     * in time, to the replicas of their keys.
+     */
+    void hedge();
+
+    /**
+     * Expires the batch at the deadline, unless it has been completed by
+     * then.
+     */
+    void expireAt(
+        std::chrono::steady_clock::time_point deadline, Deadlines::Batch batch);
+
+    /**
+     * Returns near cache counters, summed over the shards of a sharded
+     * connection. Can be called from any thread.
+     */
+    NearCache::Stats nearCacheStats() const;
+
+    /**
+     * Returns negative cache counters, summed over the shards of a
+     * sharded connection. Can be called from any thread.
+     */
+    NegativeCache::Stats negativeCacheStats() const;
+
+    /**
+     * Returns hedged read counters, summed over the shards of a sharded
+     * connection. Can be called from any thread.
+     */
+    HedgedReads::Stats hedgedReadStats() const;
+
+    /**
+     * Returns single flight counters, summed over the shards of a sharded
+     * connection. Can be called from any thread.
+     */
+    SingleFlight<GetResponses::Batch *>::Stats singleFlightStats() const;
+
+    /**
+     * Returns the number of packet buffers held by values handed over to
+     * Erlang, summed over the shards of a sharded connection. Can be
+     * called from any thread.
+     */
+    std::size_t retainedBuffers() const;
+
+    /**
+     * Counts a batch dropped as its caller no longer waited for it.
+     * Batches of a sharded connection are counted by the connection as a
+     * whole. Can be called from any thread.
+     */
+    void countDropped();
+
+    std::uint64_t droppedBatches() const;
+
+    /**
+     * Returns the in-flight limit of the connection, or @c nullptr if it
+     * is not limited. A sharded connection is limited as a whole.
+     */
+    InFlightLimit *inFlightLimit() const;
+
+    /**
+     * Sets the in-flight limit of the connection, before the connection
+     * is handed over to the caller.
+     */
+    void setInFlightLimit(std::unique_ptr<InFlightLimit> limit);
+
+    /**
+     * Returns connections backing a sharded connection. A sharded
+     * connection has no libcouchbase instance of its own and its
+     * requests are routed to the shards by key hash.
+     */
+    const std::vector<std::shared_ptr<Connection>> &shards() const;
+
+    void setShards(std::vector<std::shared_ptr<Connection>> shards);
+
     void bootstrap(const ConnectRequest &request, folly::EventBase *eventBase,
         Callback<ConnectResponse> callback);
 
+    /**
+     * Completes the bootstrap response, called from the libcouchbase
+     * bootstrap callback.
+     */
+    void bootstrapped(lcb_error_t err);
+
+    /**
+     * Retains a libcouchbase packet buffer until the returned pointer is
+     * released, which may happen on any thread and after the connection
+     * is gone.
+     */
+    BufferPtr retainBuffer(lcb_BACKBUF buffer);
+
     void get(const MultiRequest<GetRequest> &request,
-        Callback<MultiResponse<GetResponse>> callback);
+        Callback<MultiResponse<GetResponse>> callback,
+        StreamPtr<GetResponse> stream = nullptr);
 
     void store(const MultiRequest<StoreRequest> &request,
-        Callback<MultiResponse<StoreResponse>> callback);
+        Callback<MultiResponse<StoreResponse>> callback,
+        StreamPtr<StoreResponse> stream = nullptr);
 
     void remove(const MultiRequest<RemoveRequest> &request,
-        Callback<MultiResponse<RemoveResponse>> callback);
+        Callback<MultiResponse<RemoveResponse>> callback,
+        StreamPtr<RemoveResponse> stream = nullptr);
 
     void arithmetic(const MultiRequest<ArithmeticRequest> &request,
-        Callback<MultiResponse<ArithmeticResponse>> callback);
+        Callback<MultiResponse<ArithmeticResponse>> callback,
+        StreamPtr<ArithmeticResponse> stream = nullptr);
 
     void http(const HttpRequest &request, Callback<HttpResponse> callback);
 
     void durability(const MultiRequest<DurabilityRequest> &request,
         const DurabilityRequestOptions &options,
-        Callback<MultiResponse<DurabilityResponse>> callback);
+        Callback<MultiResponse<DurabilityResponse>> callback,
+        StreamPtr<DurabilityResponse> stream = nullptr);
 
 private:
-    lcb_t m_instance;
+    /**
+     * Enters the libcouchbase scheduling context, unless already entered
+     * in the current loop iteration, and flushes it at the end of the
+     * iteration. Commands of all batches submitted in one iteration are
+     * thus written to each server in a single pipelined write.
+     */
+    void schedule();
+
+    /**
+     * Arms the timer expiring batches for the earliest deadline, unless
+     * already armed for it.
+     */
+    void armDeadlines();
+
+    lcb_t m_instance{nullptr};
+
+    folly::EventBase *m_eventBase{nullptr};
+
+    std::vector<std::shared_ptr<Connection>> m_shards;
 
     uint64_t m_connectionId{0};
 
+    uint64_t m_bootstrapId{0};
+
+    bool m_scheduled{false};
+
+    bool m_decodeJson{false};
+
+    bool m_retainBuffers{false};
+
+    std::shared_ptr<RetainedBuffers> m_buffers{
+        std::make_shared<RetainedBuffers>()};
+
+    std::unique_ptr<NearCache> m_nearCache;
+
+    std::unique_ptr<NegativeCache> m_negativeCache;
+
+    std::unique_ptr<SingleFlight<GetResponses::Batch *>> m_getFlights;
+
+    std::unique_ptr<HedgedReads> m_hedgedReads;
+
+    Deadlines m_deadlines;
+
+    std::unique_ptr<InFlightLimit> m_inFlightLimit;
+
+    std::atomic<std::uint64_t> m_dropped{0};
+
+    ConnectionResponses m_connectResponses;
+    GetResponses m_getResponses;
+    StoreResponses m_storeResponses;
+    RemoveResponses m_removeResponses;
+    ArithmeticResponses m_arithmeticResponses;
+    HttpResponses m_httpResponses;
+    DurabilityResponses m_durabilityResponses;
+
     // The bootstrapCallback can be called several times with a timeout
     // so we have to count the number of times until we want to wait
     // for succesfull connection boostrapCallback
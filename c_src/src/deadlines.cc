@@ -0,0 +1,73 @@
+/**
+ * @file deadlines.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "deadlines.h"
+
+#include <algorithm>
+
+namespace cb {
+
+constexpr std::size_t Deadlines::kMinSweepSize;
+
+void Deadlines::add(std::chrono::steady_clock::time_point deadline, Batch batch)
+{
+    if (m_entries.size() >= m_sweepSize)
+        sweep();
+
+    m_entries.push_back(Entry{deadline, std::move(batch)});
+    std::push_heap(m_entries.begin(), m_entries.end(), later);
+}
+
+folly::Optional<std::chrono::milliseconds> Deadlines::arm()
+{
+    if (m_entries.empty() || m_entries.front().deadline >= m_armed)
+        return folly::none;
+
+    m_armed = m_entries.front().deadline;
+    ++m_generation;
+
+    // Event base timers have a millisecond resolution
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_armed - std::chrono::steady_clock::now() +
+        std::chrono::microseconds{999});
+
+    return std::max(wait, std::chrono::milliseconds{0});
+}
+
+bool Deadlines::expireDue(uint64_t generation)
+{
+    if (generation != m_generation)
+        return false;
+
+    m_armed = std::chrono::steady_clock::time_point::max();
+
+    auto now = std::chrono::steady_clock::now();
+    while (!m_entries.empty() && m_entries.front().deadline <= now) {
+        std::pop_heap(m_entries.begin(), m_entries.end(), later);
+        m_entries.back().batch(true);
+        m_entries.pop_back();
+    }
+
+    return true;
+}
+
+bool Deadlines::later(const Entry &a, const Entry &b)
+{
+    return a.deadline > b.deadline;
+}
+
+void Deadlines::sweep()
+{
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+                        [](const Entry &entry) { return !entry.batch(false); }),
+        m_entries.end());
+
+    std::make_heap(m_entries.begin(), m_entries.end(), later);
+    m_sweepSize = std::max(kMinSweepSize, 2 * m_entries.size());
+}
+
+} // namespace cb
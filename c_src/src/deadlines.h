@@ -0,0 +1,80 @@
+/**
+ * @file deadlines.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_DEADLINES_H
+#define CBERL_DEADLINES_H
+
+#include <folly/Optional.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cb {
+
+/**
+ * @c Deadlines keeps the deadlines of the batches of a connection, so
+ * that a single timer, armed for the earliest one, expires all of them.
+ * Completed batches are not removed at once: their entries are dropped
+ * when due or by a sweep, once the queue has doubled since the last one.
+ * It is used only on the event base of its connection.
+ */
+class Deadlines {
+public:
+    /**
+     * Checks whether the batch is still pending and, if @c expire is set,
+     * expires it.
+     */
+    using Batch = std::function<bool(bool expire)>;
+
+    Deadlines() = default;
+
+    Deadlines(const Deadlines &) = delete;
+    Deadlines &operator=(const Deadlines &) = delete;
+
+    void add(std::chrono::steady_clock::time_point deadline, Batch batch);
+
+    /**
+     * Marks the timer armed for the earliest deadline and returns the time
+     * until it, or nothing if the timer is already armed for it or no
+     * deadline is queued. The timer should be given the generation.
+     */
+    folly::Optional<std::chrono::milliseconds> arm();
+
+    uint64_t generation() const { return m_generation; }
+
+    /**
+     * Expires the batches past their deadline, unless the timer of the
+     * generation has been superseded by one armed for an earlier
+     * deadline. Returns @c false in the latter case.
+     */
+    bool expireDue(uint64_t generation);
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point deadline;
+        Batch batch;
+    };
+
+    static bool later(const Entry &a, const Entry &b);
+
+    void sweep();
+
+    std::vector<Entry> m_entries;
+    std::size_t m_sweepSize{kMinSweepSize};
+    std::chrono::steady_clock::time_point m_armed{
+        std::chrono::steady_clock::time_point::max()};
+    uint64_t m_generation{0};
+
+    static constexpr std::size_t kMinSweepSize = 1024;
+};
+
+} // namespace cb
+
+#endif // CBERL_DEADLINES_H
@@ -0,0 +1,97 @@
+/**
+ * @file hedgedReads.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "hedgedReads.h"
+
+#include <algorithm>
+
+namespace cb {
+
+HedgedReads::HedgedReads(std::chrono::milliseconds delay)
+    : m_delay{delay}
+{
+}
+
+HedgedReads::~HedgedReads()
+{
+    // The libcouchbase instance of the connection is destroyed first, so
+    // no read, whether queued or in flight, is called back anymore
+    for (auto read : m_reads)
+        delete read;
+}
+
+HedgedRead *HedgedReads::start(const void *cookie, folly::StringPiece key)
+{
+    auto read = new HedgedRead;
+    read->cookie = cookie;
+    read->key = key.str();
+    read->deadline = std::chrono::steady_clock::now() + m_delay;
+    m_queue.push_back(read);
+    m_reads.insert(read);
+    return read;
+}
+
+std::vector<HedgedRead *> HedgedReads::takeDue()
+{
+    std::vector<HedgedRead *> due;
+    auto now = std::chrono::steady_clock::now();
+    while (!m_queue.empty() && m_queue.front()->deadline <= now) {
+        auto read = m_queue.front();
+        m_queue.pop_front();
+        read->queued = false;
+
+        if (read->answered)
+            finish(read);
+        else
+            due.push_back(read);
+    }
+
+    m_hedged.fetch_add(due.size(), std::memory_order_relaxed);
+    return due;
+}
+
+folly::Optional<std::chrono::milliseconds> HedgedReads::arm()
+{
+    if (m_armed || m_queue.empty())
+        return folly::none;
+
+    m_armed = true;
+
+    // Event base timers have a millisecond resolution
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        m_queue.front()->deadline - std::chrono::steady_clock::now() +
+        std::chrono::microseconds{999});
+
+    return std::max(wait, std::chrono::milliseconds{0});
+}
+
+void HedgedReads::disarm() { m_armed = false; }
+
+void HedgedReads::finish(HedgedRead *read)
+{
+    if (read->queued || !read->getDone ||
+        (read->replicaSent && !read->replicaDone))
+        return;
+
+    m_reads.erase(read);
+    delete read;
+}
+
+void HedgedReads::countReplicaAnswer()
+{
+    m_replicaAnswers.fetch_add(1, std::memory_order_relaxed);
+}
+
+HedgedReads::Stats HedgedReads::stats() const
+{
+    Stats stats;
+    stats.hedged = m_hedged.load(std::memory_order_relaxed);
+    stats.replicaAnswers = m_replicaAnswers.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace cb
@@ -0,0 +1,114 @@
+/**
+ * @file hedgedReads.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_HEDGED_READS_H
+#define CBERL_HEDGED_READS_H
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <libcouchbase/couchbase.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace cb {
+
+/**
+ * @c HedgedRead is a get sent to the active node of a key, which is
+ * repeated against its replicas if it has not been answered in time.
+ * The batch is given the first successful answer of the two.
+ */
+struct HedgedRead {
+    // Cookie of the get, on behalf of which the answer is given
+    const void *cookie;
+    std::string key;
+    std::chrono::steady_clock::time_point deadline;
+
+    // Error of the get, held back while the replica read is in flight
+    lcb_error_t err{LCB_SUCCESS};
+
+    bool queued{true};
+    bool getDone{false};
+    bool replicaSent{false};
+    bool replicaDone{false};
+    bool answered{false};
+};
+
+/**
+ * @c HedgedReads keeps the hedged reads of a connection in the order
+ * they have been sent, which, as all of them wait equally long, is also
+ * the order in which they become due. A read is deleted by @c finish
+ * once it has left the queue and all its operations in flight have
+ * completed, or with the queue, whichever comes first. It is used only
+ * on the event base of its connection, except for its counters, which
+ * can be read from any thread.
+ */
+class HedgedReads {
+public:
+    struct Stats {
+        // Reads that became due unanswered and were sent to the replicas
+        std::uint64_t hedged{0};
+        std::uint64_t replicaAnswers{0};
+    };
+
+    explicit HedgedReads(std::chrono::milliseconds delay);
+
+    ~HedgedReads();
+
+    HedgedReads(const HedgedReads &) = delete;
+    HedgedReads &operator=(const HedgedReads &) = delete;
+
+    /**
+     * Starts a hedged read of the key on behalf of the cookie.
+     */
+    HedgedRead *start(const void *cookie, folly::StringPiece key);
+
+    /**
+     * Removes the due reads from the queue and returns those not yet
+     * answered, which should be sent to the replicas.
+     */
+    std::vector<HedgedRead *> takeDue();
+
+    /**
+     * Marks the timer of due reads armed and returns the time until the
+     * first read is due, or nothing if the timer is already armed or no
+     * read is queued.
+     */
+    folly::Optional<std::chrono::milliseconds> arm();
+
+    void disarm();
+
+    /**
+     * Deletes the read, unless it is still queued or in flight.
+     */
+    void finish(HedgedRead *read);
+
+    /**
+     * Counts a read answered by a replica of its key.
+     */
+    void countReplicaAnswer();
+
+    Stats stats() const;
+
+private:
+    const std::chrono::milliseconds m_delay;
+    std::deque<HedgedRead *> m_queue;
+    std::unordered_set<HedgedRead *> m_reads;
+    bool m_armed{false};
+
+    std::atomic<std::uint64_t> m_hedged{0};
+    std::atomic<std::uint64_t> m_replicaAnswers{0};
+};
+
+} // namespace cb
+
+#endif // CBERL_HEDGED_READS_H
@@ -0,0 +1,113 @@
+/**
+ * @file inFlightLimit.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "inFlightLimit.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace cb {
+
+InFlightLimit::InFlightLimit(Options options)
+    : m_options{options}
+    , m_window{static_cast<double>(options.maxOps)}
+{
+}
+
+bool InFlightLimit::admit(
+    std::size_t ops, std::size_t bytes, std::function<void()> submit)
+{
+    std::unique_lock<std::mutex> lock{m_mutex};
+
+    // Queued requests go first
+    if (m_queue.empty() && fits(ops, bytes)) {
+        m_ops += ops;
+        m_bytes += bytes;
+        lock.unlock();
+        submit();
+        return true;
+    }
+
+    if (!m_options.queue || !fitsQueue(ops, bytes))
+        return false;
+
+    m_queuedOps += ops;
+    m_queuedBytes += bytes;
+    m_queue.push_back(Pending{ops, bytes, std::move(submit)});
+    return true;
+}
+
+void InFlightLimit::release(std::size_t ops, std::size_t bytes,
+    std::chrono::steady_clock::duration latency)
+{
+    std::vector<std::function<void()>> admitted;
+
+    {
+        std::lock_guard<std::mutex> guard{m_mutex};
+        m_ops -= ops;
+        m_bytes -= bytes;
+        adjust(ops, latency);
+
+        while (!m_queue.empty() &&
+            fits(m_queue.front().ops, m_queue.front().bytes)) {
+            auto &pending = m_queue.front();
+            m_ops += pending.ops;
+            m_bytes += pending.bytes;
+            m_queuedOps -= pending.ops;
+            m_queuedBytes -= pending.bytes;
+            admitted.push_back(std::move(pending.submit));
+            m_queue.pop_front();
+        }
+    }
+
+    for (auto &submit : admitted)
+        submit();
+}
+
+bool InFlightLimit::fits(std::size_t ops, std::size_t bytes) const
+{
+    if (m_ops == 0)
+        return true;
+
+    return (m_options.maxOps == 0 || m_ops + ops <= m_window) &&
+        (m_options.maxBytes == 0 || m_bytes + bytes <= m_options.maxBytes);
+}
+
+bool InFlightLimit::fitsQueue(std::size_t ops, std::size_t bytes) const
+{
+    if (m_queue.empty())
+        return true;
+
+    return (m_options.maxQueuedOps == 0 ||
+               m_queuedOps + ops <= m_options.maxQueuedOps) &&
+        (m_options.maxQueuedBytes == 0 ||
+            m_queuedBytes + bytes <= m_options.maxQueuedBytes);
+}
+
+void InFlightLimit::adjust(
+    std::size_t ops, std::chrono::steady_clock::duration latency)
+{
+    if (m_options.targetLatency.count() == 0 || m_options.maxOps == 0)
+        return;
+
+    if (latency <= m_options.targetLatency) {
+        m_window = std::min<double>(
+            m_options.maxOps, m_window + ops / m_window);
+        return;
+    }
+
+    // Requests in flight during a slowdown complete late one after
+    // another, so the window is decreased once for all of them
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_decreased < m_options.targetLatency)
+        return;
+
+    m_window = std::max(1.0, m_window / 2);
+    m_decreased = now;
+}
+
+} // namespace cb
@@ -0,0 +1,104 @@
+/**
+ * @file inFlightLimit.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_IN_FLIGHT_LIMIT_H
+#define CBERL_IN_FLIGHT_LIMIT_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace cb {
+
+/**
+ * @c InFlightLimit bounds the operations and bytes of requests a
+ * connection has in flight. Requests over the limit are either rejected
+ * or queued until earlier requests complete. The queue is bounded as
+ * well, requests over its bound are rejected. The operation window can
+ * be adjusted to the completion latency of requests: it grows by one
+ * operation per window of operations completed within the target
+ * latency and is halved, at most once per target latency, when a
+ * request completes later (AIMD).
+ *
+ * A request is admitted whenever nothing is in flight, and queued
+ * whenever nothing is queued, so requests larger than the window or the
+ * queue bound are not starved. The limit can be used from
+ * any thread.
+ */
+class InFlightLimit {
+public:
+    struct Options {
+        // Limits of operations and bytes in flight, 0 for no limit
+        std::size_t maxOps{0};
+        std::size_t maxBytes{0};
+
+        // Whether requests over the limit are queued or rejected
+        bool queue{false};
+
+        // Bounds of operations and bytes queued, 0 for no bound
+        std::size_t maxQueuedOps{0};
+        std::size_t maxQueuedBytes{0};
+
+        // Completion latency the operation window is adjusted to, 0 for
+        // a fixed window
+        std::chrono::microseconds targetLatency{0};
+
+        bool enabled() const { return maxOps > 0 || maxBytes > 0; }
+    };
+
+    explicit InFlightLimit(Options options);
+
+    InFlightLimit(const InFlightLimit &) = delete;
+    InFlightLimit &operator=(const InFlightLimit &) = delete;
+
+    /**
+     * Admits a request of @c ops operations and @c bytes bytes and runs
+     * @c submit, at once if the request fits within the limit or, when
+     * queueing, once it does. Returns @c false if the request has been
+     * rejected, as it is over the limit and, when queueing, over the
+     * queue bound.
+     */
+    bool admit(
+        std::size_t ops, std::size_t bytes, std::function<void()> submit);
+
+    /**
+     * Releases an admitted request completed after @c latency and runs
+     * queued requests that fit within the limit afterwards.
+     */
+    void release(std::size_t ops, std::size_t bytes,
+        std::chrono::steady_clock::duration latency);
+
+private:
+    struct Pending {
+        std::size_t ops;
+        std::size_t bytes;
+        std::function<void()> submit;
+    };
+
+    bool fits(std::size_t ops, std::size_t bytes) const;
+
+    bool fitsQueue(std::size_t ops, std::size_t bytes) const;
+
+    void adjust(std::size_t ops, std::chrono::steady_clock::duration latency);
+
+    const Options m_options;
+
+    std::mutex m_mutex;
+    double m_window;
+    std::size_t m_ops{0};
+    std::size_t m_bytes{0};
+    std::chrono::steady_clock::time_point m_decreased;
+    std::deque<Pending> m_queue;
+    std::size_t m_queuedOps{0};
+    std::size_t m_queuedBytes{0};
+};
+
+} // namespace cb
+
+#endif // CBERL_IN_FLIGHT_LIMIT_H
@@ -0,0 +1,78 @@
+/**
+ * @file nearCache.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "nearCache.h"
+
+#include <iterator>
+
+namespace cb {
+
+NearCache::NearCache(std::size_t capacity, std::chrono::milliseconds ttl)
+    : m_capacity{capacity}
+    , m_ttl{ttl}
+{
+}
+
+const NearCache::Entry *NearCache::find(folly::StringPiece key)
+{
+    auto it = m_index.find(key);
+    if (it != m_index.end() &&
+        it->second->expires <= std::chrono::steady_clock::now()) {
+        erase(it->second);
+        it = m_index.end();
+    }
+
+    if (it == m_index.end()) {
+        miss(key);
+        return nullptr;
+    }
+
+    hit();
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &*it->second;
+}
+
+void NearCache::fill(folly::StringPiece key, folly::StringPiece value,
+    lcb_uint32_t flags, lcb_cas_t cas)
+{
+    if (!takeFill(key))
+        return;
+
+    auto size = key.size() + value.size();
+    if (size > m_capacity)
+        return;
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+        erase(it->second);
+
+    while (m_size + size > m_capacity)
+        erase(std::prev(m_entries.end()));
+
+    m_entries.push_front(Entry{key.str(), value.str(), flags, cas,
+        std::chrono::steady_clock::now() + m_ttl});
+    m_index.emplace(m_entries.front().key, m_entries.begin());
+    m_size += size;
+}
+
+void NearCache::invalidate(folly::StringPiece key)
+{
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+        erase(it->second);
+
+    cancelFills(key);
+}
+
+void NearCache::erase(Entries::iterator it)
+{
+    m_size -= it->key.size() + it->value.size();
+    m_index.erase(it->key);
+    m_entries.erase(it);
+}
+
+} // namespace cb
@@ -0,0 +1,80 @@
+/**
+ * @file nearCache.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_NEAR_CACHE_H
+#define CBERL_NEAR_CACHE_H
+
+#include "cacheBase.h"
+
+#include <folly/Range.h>
+#include <libcouchbase/couchbase.h>
+
+#include <chrono>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace cb {
+
+/**
+ * @c NearCache keeps recently read documents of a connection, so that
+ * plain gets of hot keys are served without a round trip. It is a LRU
+ * cache bounded by the total size of keys and values, whose entries
+ * expire after a fixed time. Entries are invalidated by mutations made
+ * through the same connection; changes made by other clients are seen
+ * once the entry expires.
+ *
+ * A sharded connection has a separate cache on each shard.
+ */
+class NearCache : public CacheBase {
+public:
+    struct Entry {
+        std::string key;
+        std::string value;
+        lcb_uint32_t flags;
+        lcb_cas_t cas;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    NearCache(std::size_t capacity, std::chrono::milliseconds ttl);
+
+    /**
+     * Returns the entry of a key, or @c nullptr if it is not cached. The
+     * entry is valid until the cache is modified. A miss registers a fill
+     * of the key.
+     */
+    const Entry *find(folly::StringPiece key);
+
+    /**
+     * Caches a document read by a get, if its fill is still registered.
+     */
+    void fill(folly::StringPiece key, folly::StringPiece value,
+        lcb_uint32_t flags, lcb_cas_t cas);
+
+    /**
+     * Removes the key from the cache and cancels its pending fills.
+     */
+    void invalidate(folly::StringPiece key);
+
+private:
+    using Entries = std::list<Entry>;
+
+    void erase(Entries::iterator it);
+
+    const std::size_t m_capacity;
+    const std::chrono::milliseconds m_ttl;
+    std::size_t m_size{0};
+
+    // Most recently used entries first; the index references keys owned
+    // by the entries
+    Entries m_entries;
+    std::unordered_map<folly::StringPiece, Entries::iterator, Hash> m_index;
+};
+
+} // namespace cb
+
+#endif // CBERL_NEAR_CACHE_H
@@ -0,0 +1,68 @@
+/**
+ * @file negativeCache.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "negativeCache.h"
+
+#include <iterator>
+
+namespace cb {
+
+NegativeCache::NegativeCache(
+    std::size_t capacity, std::chrono::milliseconds ttl)
+    : m_capacity{capacity}
+    , m_ttl{ttl}
+{
+}
+
+bool NegativeCache::absent(folly::StringPiece key)
+{
+    auto now = std::chrono::steady_clock::now();
+    while (!m_entries.empty() && m_entries.back().expires <= now)
+        erase(std::prev(m_entries.end()));
+
+    if (m_index.find(key) != m_index.end()) {
+        hit();
+        return true;
+    }
+
+    miss(key);
+    return false;
+}
+
+void NegativeCache::fill(folly::StringPiece key)
+{
+    if (!takeFill(key))
+        return;
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+        erase(it->second);
+
+    if (m_entries.size() >= m_capacity)
+        erase(std::prev(m_entries.end()));
+
+    m_entries.push_front(
+        Entry{key.str(), std::chrono::steady_clock::now() + m_ttl});
+    m_index.emplace(m_entries.front().key, m_entries.begin());
+}
+
+void NegativeCache::invalidate(folly::StringPiece key)
+{
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+        erase(it->second);
+
+    cancelFills(key);
+}
+
+void NegativeCache::erase(Entries::iterator it)
+{
+    m_index.erase(it->key);
+    m_entries.erase(it);
+}
+
+} // namespace cb
@@ -0,0 +1,72 @@
+/**
+ * @file negativeCache.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_NEGATIVE_CACHE_H
+#define CBERL_NEGATIVE_CACHE_H
+
+#include "cacheBase.h"
+
+#include <folly/Range.h>
+
+#include <chrono>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace cb {
+
+/**
+ * @c NegativeCache remembers keys recently found absent by gets of a
+ * connection, so that further plain gets of them are answered with
+ * @c LCB_KEY_ENOENT without a round trip. It holds a bounded number of
+ * keys, which expire after a fixed time. Keys are dropped once stored
+ * or incremented through the same connection; documents created by
+ * other clients are seen once the key expires.
+ */
+class NegativeCache : public CacheBase {
+public:
+    NegativeCache(std::size_t capacity, std::chrono::milliseconds ttl);
+
+    /**
+     * Checks whether the key is known to be absent. Otherwise a fill of
+     * the key is registered.
+     */
+    bool absent(folly::StringPiece key);
+
+    /**
+     * Remembers a key found absent by a get, if its fill is still
+     * registered.
+     */
+    void fill(folly::StringPiece key);
+
+    /**
+     * Forgets the key and cancels its pending fills.
+     */
+    void invalidate(folly::StringPiece key);
+
+private:
+    struct Entry {
+        std::string key;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    using Entries = std::list<Entry>;
+
+    void erase(Entries::iterator it);
+
+    const std::size_t m_capacity;
+    const std::chrono::milliseconds m_ttl;
+
+    // Most recently filled entries first; as all entries live equally
+    // long, the last entry is always the first to expire
+    Entries m_entries;
+    std::unordered_map<folly::StringPiece, Entries::iterator, Hash> m_index;
+};
+
+} // namespace cb
+
+#endif // CBERL_NEGATIVE_CACHE_H
@@ -9,16 +9,23 @@
 
 namespace cb {
 
-ArithmeticRequest::ArithmeticRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
-    , m_delta{std::get<1>(raw)}
-    , m_create{std::get<2>(raw)}
-    , m_initial{std::get<3>(raw)}
-    , m_expiry{std::get<4>(raw)}
+ArithmeticRequest::ArithmeticRequest(const Raw &raw)
+    : ArithmeticRequest{std::get<0>(raw), std::get<1>(raw), std::get<2>(raw),
+          std::get<3>(raw), std::get<4>(raw)}
 {
 }
 
-const std::string &ArithmeticRequest::key() const { return m_key; }
+ArithmeticRequest::ArithmeticRequest(folly::StringPiece key,
+    std::int64_t delta, bool create, std::uint64_t initial, lcb_time_t expiry)
+    : m_key{key}
+    , m_delta{delta}
+    , m_create{create}
+    , m_initial{initial}
+    , m_expiry{expiry}
+{
+}
+
+folly::StringPiece ArithmeticRequest::key() const { return m_key; }
 
 std::int64_t ArithmeticRequest::delta() const { return m_delta; }
 
@@ -28,4 +35,13 @@ std::uint64_t ArithmeticRequest::initial() const { return m_initial; }
 
 lcb_time_t ArithmeticRequest::expiry() const { return m_expiry; }
 
+void ArithmeticRequest::toCommand(Command &command) const
+{
+    LCB_CMD_SET_KEY(&command, m_key.data(), m_key.size());
+    command.delta = m_delta;
+    command.create = m_create;
+    command.initial = m_initial;
+    command.exptime = m_expiry;
+}
+
 } // namespace cb
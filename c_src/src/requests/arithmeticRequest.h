@@ -8,6 +8,7 @@
 #ifndef CBERL_ARITHMETIC_REQUEST_H
 #define CBERL_ARITHMETIC_REQUEST_H
 
+#include <folly/Range.h>
 #include <libcouchbase/couchbase.h>
 
 #include <string>
@@ -17,12 +18,21 @@ namespace cb {
 
 class ArithmeticRequest {
 public:
+    using Command = lcb_CMDCOUNTER;
+
     using Raw =
         std::tuple<std::string, std::int64_t, bool, std::uint64_t, lcb_time_t>;
 
-    ArithmeticRequest(Raw raw);
+    /**
+     * Creates a request borrowing the key from @c raw, which has to
+     * outlive the request.
+     */
+    ArithmeticRequest(const Raw &raw);
+
+    ArithmeticRequest(folly::StringPiece key, std::int64_t delta, bool create,
+        std::uint64_t initial, lcb_time_t expiry);
 
-    const std::string &key() const;
+    folly::StringPiece key() const;
 
     std::int64_t delta() const;
 
@@ -32,8 +42,14 @@ public:
 
     lcb_time_t expiry() const;
 
+    /**
+     * Fills the libcouchbase command, which borrows the key from
+     * the request.
+     */
+    void toCommand(Command &command) const;
+
 private:
-    std::string m_key;
+    folly::StringPiece m_key;
     std::int64_t m_delta;
     bool m_create;
     std::uint64_t m_initial;
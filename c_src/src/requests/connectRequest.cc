@@ -7,8 +7,12 @@
 
 #include "connectRequest.h"
 
+#include <folly/Optional.h>
+
 namespace cb {
 
+constexpr std::size_t ConnectRequest::kMaxShards;
+
 ConnectRequest::ConnectRequest(std::string host, std::string username,
     std::string password, std::string bucket,
     const std::vector<std::tuple<nifpp::str_atom, int>> &options)
@@ -34,4 +38,55 @@ ConnectRequest::options() const
     return m_options;
 }
 
+std::size_t ConnectRequest::shards() const
+{
+    std::string optName;
+    int optValue;
+    for (const auto &option : m_options) {
+        std::tie(optName, optValue) = option;
+        if (optName == "shards" && optValue > 1) {
+            return optValue;
+        }
+    }
+    return 1;
+}
+
+InFlightLimit::Options ConnectRequest::inFlightLimit() const
+{
+    InFlightLimit::Options limit;
+    folly::Optional<std::size_t> maxQueuedOps;
+    folly::Optional<std::size_t> maxQueuedBytes;
+    std::string optName;
+    int optValue;
+    for (const auto &option : m_options) {
+        std::tie(optName, optValue) = option;
+        if (optValue < 0)
+            continue;
+
+        if (optName == "max_in_flight") {
+            limit.maxOps = optValue;
+        }
+        else if (optName == "max_in_flight_bytes") {
+            limit.maxBytes = optValue;
+        }
+        else if (optName == "in_flight_queue") {
+            limit.queue = optValue != 0;
+        }
+        else if (optName == "max_queued_ops") {
+            maxQueuedOps = optValue;
+        }
+        else if (optName == "max_queued_bytes") {
+            maxQueuedBytes = optValue;
+        }
+        else if (optName == "in_flight_target_latency") {
+            limit.targetLatency = std::chrono::microseconds{optValue};
+        }
+    }
+
+    // The queue holds as much as may be in flight unless told otherwise
+    limit.maxQueuedOps = maxQueuedOps.value_or(limit.maxOps);
+    limit.maxQueuedBytes = maxQueuedBytes.value_or(limit.maxBytes);
+    return limit;
+}
+
 } // namespace cb
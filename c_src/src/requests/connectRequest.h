@@ -8,6 +8,7 @@
 #ifndef CBERL_CONNECT_REQUEST_H
 #define CBERL_CONNECT_REQUEST_H
 
+#include "inFlightLimit.h"
 #include "nifpp.h"
 
 #include <libcouchbase/couchbase.h>
@@ -20,6 +21,9 @@ namespace cb {
 
 class ConnectRequest {
 public:
+    // Each shard is a libcouchbase instance with its own sockets
+    static constexpr std::size_t kMaxShards = 64;
+
     ConnectRequest(std::string host, std::string username, std::string password,
         std::string bucket,
         const std::vector<std::tuple<nifpp::str_atom, int>> &options);
@@ -34,6 +38,21 @@ public:
 
     const std::vector<std::tuple<nifpp::str_atom, int>> &options() const;
 
+    /**
+     * Returns the number of libcouchbase instances backing the connection,
+     * as requested with the 'shards' option (1 by default). Callers are
+     * expected to reject requests for more than @c kMaxShards.
+     */
+    std::size_t shards() const;
+
+    /**
+     * Returns the in-flight limit of the connection, as requested with
+     * the 'max_in_flight', 'max_in_flight_bytes', 'in_flight_queue',
+     * 'max_queued_ops', 'max_queued_bytes' and 'in_flight_target_latency'
+     * options. The queue is bounded by the in-flight limits by default.
+     */
+    InFlightLimit::Options inFlightLimit() const;
+
 private:
     std::string m_host;
     std::string m_username;
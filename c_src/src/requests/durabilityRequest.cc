@@ -9,16 +9,27 @@
 
 namespace cb {
 
-DurabilityRequest::DurabilityRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
-    , m_cas{std::get<1>(raw)}
+DurabilityRequest::DurabilityRequest(const Raw &raw)
+    : DurabilityRequest{std::get<0>(raw), std::get<1>(raw)}
 {
 }
 
-const std::string &DurabilityRequest::key() const { return m_key; }
+DurabilityRequest::DurabilityRequest(folly::StringPiece key, lcb_cas_t cas)
+    : m_key{key}
+    , m_cas{cas}
+{
+}
+
+folly::StringPiece DurabilityRequest::key() const { return m_key; }
 
 lcb_cas_t DurabilityRequest::cas() const { return m_cas; }
 
+void DurabilityRequest::toCommand(Command &command) const
+{
+    LCB_CMD_SET_KEY(&command, m_key.data(), m_key.size());
+    command.cas = m_cas;
+}
+
 DurabilityRequestOptions::DurabilityRequestOptions(Raw raw)
     : m_persistTo{std::get<0>(raw)}
     , m_replicateTo{std::get<1>(raw)}
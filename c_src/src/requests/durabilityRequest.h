@@ -8,6 +8,7 @@
 #ifndef CBERL_DURABILITY_REQUEST_H
 #define CBERL_DURABILITY_REQUEST_H
 
+#include <folly/Range.h>
 #include <libcouchbase/couchbase.h>
 
 #include <string>
@@ -17,16 +18,30 @@ namespace cb {
 
 class DurabilityRequest {
 public:
+    using Command = lcb_CMDENDURE;
+
     using Raw = std::tuple<std::string, lcb_cas_t>;
 
-    DurabilityRequest(Raw raw);
+    /**
+     * Creates a request borrowing the key from @c raw, which has to
+     * outlive the request.
+     */
+    DurabilityRequest(const Raw &raw);
+
+    DurabilityRequest(folly::StringPiece key, lcb_cas_t cas);
 
-    const std::string &key() const;
+    folly::StringPiece key() const;
 
     lcb_cas_t cas() const;
 
+    /**
+     * Fills the libcouchbase command, which borrows the key from
+     * the request.
+     */
+    void toCommand(Command &command) const;
+
 private:
-    std::string m_key;
+    folly::StringPiece m_key;
     lcb_cas_t m_cas;
 };
 
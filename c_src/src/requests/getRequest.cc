@@ -9,17 +9,29 @@
 
 namespace cb {
 
-GetRequest::GetRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
-    , m_expiry{std::get<1>(raw)}
-    , m_lock{std::get<2>(raw)}
+GetRequest::GetRequest(const Raw &raw)
+    : GetRequest{std::get<0>(raw), std::get<1>(raw), std::get<2>(raw)}
 {
 }
 
-const std::string &GetRequest::key() const { return m_key; }
+GetRequest::GetRequest(folly::StringPiece key, lcb_time_t expiry, bool lock)
+    : m_key{key}
+    , m_expiry{expiry}
+    , m_lock{lock}
+{
+}
+
+folly::StringPiece GetRequest::key() const { return m_key; }
 
 lcb_time_t GetRequest::expiry() const { return m_expiry; }
 
 bool GetRequest::lock() const { return m_lock; }
 
+void GetRequest::toCommand(Command &command) const
+{
+    LCB_CMD_SET_KEY(&command, m_key.data(), m_key.size());
+    command.exptime = m_expiry;
+    command.lock = m_lock;
+}
+
 } // namespace cb
@@ -8,6 +8,7 @@
 #ifndef CBERL_GET_REQUEST_H
 #define CBERL_GET_REQUEST_H
 
+#include <folly/Range.h>
 #include <libcouchbase/couchbase.h>
 
 #include <string>
@@ -17,18 +18,32 @@ namespace cb {
 
 class GetRequest {
 public:
+    using Command = lcb_CMDGET;
+
     using Raw = std::tuple<std::string, lcb_time_t, bool>;
 
-    GetRequest(Raw raw);
+    /**
+     * Creates a request borrowing the key from @c raw, which has to
+     * outlive the request.
+     */
+    GetRequest(const Raw &raw);
+
+    GetRequest(folly::StringPiece key, lcb_time_t expiry, bool lock);
 
-    const std::string &key() const;
+    folly::StringPiece key() const;
 
     lcb_time_t expiry() const;
 
     bool lock() const;
 
+    /**
+     * Fills the libcouchbase command, which borrows the key from
+     * the request.
+     */
+    void toCommand(Command &command) const;
+
 private:
-    std::string m_key;
+    folly::StringPiece m_key;
     lcb_time_t m_expiry;
     bool m_lock;
 };
@@ -8,23 +8,171 @@
 #ifndef CBERL_MULTI_REQUEST_H
 #define CBERL_MULTI_REQUEST_H
 
+#include <libcouchbase/couchbase.h>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 namespace cb {
 
+/**
+ * @c MultiRequest holds libcouchbase commands of a bulk request in a single
+ * preallocated buffer. Keys and values referenced by the commands are kept
+ * alive by the request owner.
+ */
 template <class RequestT> class MultiRequest {
 public:
+    using Command = typename RequestT::Command;
+
+    MultiRequest() = default;
+
+    /**
+     * Creates an empty request with room for @c capacity commands, which
+     * reference memory kept alive by @c owner.
+     */
+    MultiRequest(std::size_t capacity, std::shared_ptr<void> owner)
+        : m_commands{new Command[capacity], std::default_delete<Command[]>{}}
+        , m_capacity{capacity}
+        , m_owner{std::move(owner)}
+    {
+        static_assert(std::is_trivially_copyable<Command>::value,
+            "libcouchbase commands must be trivially copyable");
+    }
+
     MultiRequest(std::vector<typename RequestT::Raw> rawRequests)
+        : MultiRequest{rawRequests.size(), nullptr}
     {
-        for (auto &rawRequest : rawRequests) {
-            m_requests.emplace_back(std::move(rawRequest));
+        auto raw = std::make_shared<std::vector<typename RequestT::Raw>>(
+            std::move(rawRequests));
+        for (const auto &rawRequest : *raw) {
+            add(RequestT{rawRequest});
         }
+        m_owner = std::move(raw);
+    }
+
+    /**
+     * Appends a command for @c request. The request has to borrow its
+     * keys and values from memory kept alive by the owner.
+     */
+    void add(const RequestT &request)
+    {
+        auto command = emplace();
+        request.toCommand(*command);
+        m_bytes += bytes(*command);
+    }
+
+    std::size_t size() const { return m_size; }
+
+    /**
+     * Returns the total size of keys and values of the commands.
+     */
+    std::size_t bytes() const { return m_bytes; }
+
+    bool empty() const { return m_size == 0; }
+
+    const Command *commands() const { return m_commands.get(); }
+
+    /**
+     * Returns the time after which the caller no longer waits for the
+     * response, @c time_point::max() if it waits indefinitely.
+     */
+    std::chrono::steady_clock::time_point deadline() const
+    {
+        return m_deadline;
+    }
+
+    void setDeadline(std::chrono::steady_clock::time_point deadline)
+    {
+        m_deadline = deadline;
+    }
+
+    /**
+     * Returns the flag raised once the caller of the request is gone, if
+     * the caller is watched.
+     */
+    const std::shared_ptr<const std::atomic<bool>> &abandoned() const
+    {
+        return m_abandoned;
+    }
+
+    void setAbandoned(std::shared_ptr<const std::atomic<bool>> abandoned)
+    {
+        m_abandoned = std::move(abandoned);
     }
 
-    const std::vector<RequestT> &requests() const { return m_requests; }
+    /**
+     * Splits the request into @c count requests, assigning each key to
+     * a shard based on its hash. Requests for the same key always end up
+     * in the same shard, in their original order.
+     */
+    std::vector<MultiRequest<RequestT>> shard(std::size_t count) const
+    {
+        std::vector<std::size_t> indices(m_size);
+        std::vector<std::size_t> sizes(count);
+        for (std::size_t i = 0; i < m_size; ++i) {
+            indices[i] = hash(m_commands.get()[i]) % count;
+            ++sizes[indices[i]];
+        }
+
+        std::vector<MultiRequest<RequestT>> shards;
+        shards.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            shards.emplace_back(sizes[i], m_owner);
+            shards.back().m_deadline = m_deadline;
+            shards.back().m_abandoned = m_abandoned;
+        }
+        for (std::size_t i = 0; i < m_size; ++i) {
+            auto &shard = shards[indices[i]];
+            *shard.emplace() = m_commands.get()[i];
+            shard.m_bytes += bytes(m_commands.get()[i]);
+        }
+        return shards;
+    }
 
 private:
-    std::vector<RequestT> m_requests;
+    Command *emplace()
+    {
+        assert(m_size < m_capacity);
+        auto command = &m_commands.get()[m_size++];
+        *command = Command{};
+        return command;
+    }
+
+    template <class CommandT> static std::size_t bytes(const CommandT &command)
+    {
+        return command.key.contig.nbytes;
+    }
+
+    static std::size_t bytes(const lcb_CMDSTORE &command)
+    {
+        return command.key.contig.nbytes + command.value.u_buf.contig.nbytes;
+    }
+
+    // FNV-1a
+    static std::size_t hash(const Command &command)
+    {
+        auto key = static_cast<const unsigned char *>(command.key.contig.bytes);
+        std::uint64_t value = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < command.key.contig.nbytes; ++i) {
+            value ^= key[i];
+            value *= 1099511628211ULL;
+        }
+        return value;
+    }
+
+    std::shared_ptr<Command> m_commands;
+    std::size_t m_size{0};
+    std::size_t m_capacity{0};
+    std::size_t m_bytes{0};
+    std::chrono::steady_clock::time_point m_deadline{
+        std::chrono::steady_clock::time_point::max()};
+    std::shared_ptr<const std::atomic<bool>> m_abandoned;
+    std::shared_ptr<void> m_owner;
 };
 
 } // namespace cb
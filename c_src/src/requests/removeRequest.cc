@@ -9,14 +9,25 @@
 
 namespace cb {
 
-RemoveRequest::RemoveRequest(Raw raw)
-    : m_key{std::get<0>(raw)}
-    , m_cas{std::get<1>(raw)}
+RemoveRequest::RemoveRequest(const Raw &raw)
+    : RemoveRequest{std::get<0>(raw), std::get<1>(raw)}
 {
 }
 
-const std::string &RemoveRequest::key() const { return m_key; }
+RemoveRequest::RemoveRequest(folly::StringPiece key, lcb_cas_t cas)
+    : m_key{key}
+    , m_cas{cas}
+{
+}
+
+folly::StringPiece RemoveRequest::key() const { return m_key; }
 
 lcb_cas_t RemoveRequest::cas() const { return m_cas; }
 
+void RemoveRequest::toCommand(Command &command) const
+{
+    LCB_CMD_SET_KEY(&command, m_key.data(), m_key.size());
+    command.cas = m_cas;
+}
+
 } // namespace cb
@@ -8,6 +8,7 @@
 #ifndef CBERL_REMOVE_REQUEST_H
 #define CBERL_REMOVE_REQUEST_H
 
+#include <folly/Range.h>
 #include <libcouchbase/couchbase.h>
 
 #include <string>
@@ -17,16 +18,30 @@ namespace cb {
 
 class RemoveRequest {
 public:
+    using Command = lcb_CMDREMOVE;
+
     using Raw = std::tuple<std::string, lcb_cas_t>;
 
-    RemoveRequest(Raw raw);
+    /**
+     * Creates a request borrowing the key from @c raw, which has to
+     * outlive the request.
+     */
+    RemoveRequest(const Raw &raw);
+
+    RemoveRequest(folly::StringPiece key, lcb_cas_t cas);
 
-    const std::string &key() const;
+    folly::StringPiece key() const;
 
     lcb_cas_t cas() const;
 
+    /**
+     * Fills the libcouchbase command, which borrows the key from
+     * the request.
+     */
+    void toCommand(Command &command) const;
+
 private:
-    std::string m_key;
+    folly::StringPiece m_key;
     lcb_cas_t m_cas;
 };
 
@@ -9,26 +9,44 @@
 
 namespace cb {
 
-StoreRequest::StoreRequest(Raw raw)
-    : m_operation{static_cast<lcb_storage_t>(std::get<0>(raw))}
-    , m_key{std::get<1>(raw)}
-    , m_value{std::get<2>(raw)}
-    , m_flags{std::get<3>(raw)}
-    , m_cas{std::get<4>(raw)}
-    , m_expiry{std::get<5>(raw)}
+StoreRequest::StoreRequest(const Raw &raw)
+    : StoreRequest{std::get<0>(raw), std::get<1>(raw), std::get<2>(raw),
+          std::get<3>(raw), std::get<4>(raw), std::get<5>(raw)}
+{
+}
+
+StoreRequest::StoreRequest(int operation, folly::StringPiece key,
+    folly::StringPiece value, lcb_uint32_t flags, lcb_cas_t cas,
+    lcb_time_t expiry)
+    : m_operation{static_cast<lcb_storage_t>(operation)}
+    , m_key{key}
+    , m_value{value}
+    , m_flags{flags}
+    , m_cas{cas}
+    , m_expiry{expiry}
 {
 }
 
 lcb_storage_t StoreRequest::operation() const { return m_operation; }
 
-const std::string &StoreRequest::key() const { return m_key; }
+folly::StringPiece StoreRequest::key() const { return m_key; }
 
 lcb_cas_t StoreRequest::cas() const { return m_cas; }
 
 lcb_uint32_t StoreRequest::flags() const { return m_flags; }
 
-const std::string &StoreRequest::value() const { return m_value; }
+folly::StringPiece StoreRequest::value() const { return m_value; }
 
 lcb_time_t StoreRequest::expiry() const { return m_expiry; }
 
+void StoreRequest::toCommand(Command &command) const
+{
+    LCB_CMD_SET_KEY(&command, m_key.data(), m_key.size());
+    LCB_CMD_SET_VALUE(&command, m_value.data(), m_value.size());
+    command.operation = m_operation;
+    command.cas = m_cas;
+    command.flags = m_flags;
+    command.exptime = m_expiry;
+}
+
 } // namespace cb
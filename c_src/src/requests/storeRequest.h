@@ -8,6 +8,7 @@
 #ifndef CBERL_STORE_REQUEST_H
 #define CBERL_STORE_REQUEST_H
 
+#include <folly/Range.h>
 #include <libcouchbase/couchbase.h>
 
 #include <string>
@@ -17,16 +18,26 @@ namespace cb {
 
 class StoreRequest {
 public:
+    using Command = lcb_CMDSTORE;
+
     using Raw = std::tuple<int, std::string, std::string, lcb_uint32_t,
         lcb_cas_t, lcb_time_t>;
 
-    StoreRequest(Raw raw);
+    /**
+     * Creates a request borrowing the key and the value from @c raw,
+     * which has to outlive the request.
+     */
+    StoreRequest(const Raw &raw);
+
+    StoreRequest(int operation, folly::StringPiece key,
+        folly::StringPiece value, lcb_uint32_t flags, lcb_cas_t cas,
+        lcb_time_t expiry);
 
     lcb_storage_t operation() const;
 
-    const std::string &key() const;
+    folly::StringPiece key() const;
 
-    const std::string &value() const;
+    folly::StringPiece value() const;
 
     lcb_uint32_t flags() const;
 
@@ -34,10 +45,16 @@ public:
 
     lcb_time_t expiry() const;
 
+    /**
+     * Fills the libcouchbase command, which borrows the key and the value from
+     * the request.
+     */
+    void toCommand(Command &command) const;
+
 private:
     lcb_storage_t m_operation;
-    std::string m_key;
-    std::string m_value;
+    folly::StringPiece m_key;
+    folly::StringPiece m_value;
     lcb_uint32_t m_flags;
     lcb_cas_t m_cas;
     lcb_time_t m_expiry;
@@ -7,10 +7,12 @@
 #ifndef COUCHBASE_RESPONSE_PLACEHOLDER_H
 #define COUCHBASE_RESPONSE_PLACEHOLDER_H
 
+#include <array>
+#include <atomic>
+#include <cassert>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <unordered_map>
 
 namespace cb {
 
@@ -18,9 +20,61 @@ namespace cb {
  * @c ResponsePlaceholder provides interface for storing cberl Responses
  * until they are completed by asynchronous responses from Couchbase
  * server.
+ *
+ * Responses are kept in a preallocated table of slots. The id of a
+ * response encodes the slot index in its lower 32 bits and the slot
+ * generation in its upper 32 bits, so lookups are a direct index and
+ * ids of released slots never match a reused slot. Free slots are kept
+ * on a lock-free stack; the table only takes a lock when it has to grow.
  */
 template <class TRes> class ResponsePlaceholder {
 public:
+    /**
+     * A slot of the table holding a single response with its callback.
+     * Pointers to a batch stay valid while the batch is referenced, so
+     * a batch can be passed directly as the libcouchbase command cookie.
+     * The slot is recycled once the response has been completed or
+     * forgotten and the last reference has been released.
+     */
+    class Batch {
+    public:
+        TRes &response() { return m_value; }
+
+        uint64_t id() const;
+
+        void retain();
+
+        void release();
+
+        /**
+         * Detach the batch from the table and execute its callback with
+         * the response moved out of the slot. Only the first call
+         * executes the callback, and it drops the reference taken by
+         * @c storeBatch.
+         */
+        void complete();
+
+    private:
+        friend class ResponsePlaceholder;
+
+        bool take(TRes &value, std::function<void(const TRes &)> &callback);
+
+        TRes m_value;
+        std::function<void(const TRes &)> m_callback;
+        ResponsePlaceholder *m_owner{nullptr};
+        uint32_t m_index{0};
+        std::atomic<uint32_t> m_generation{0};
+        std::atomic<uint32_t> m_refs{0};
+        std::atomic<bool> m_busy{false};
+        std::atomic<uint32_t> m_next{kNoSlot};
+    };
+
+    ResponsePlaceholder();
+
+    ~ResponsePlaceholder();
+
+    ResponsePlaceholder(const ResponsePlaceholder &) = delete;
+    ResponsePlaceholder &operator=(const ResponsePlaceholder &) = delete;
 
     /**
      * Remove the response from the cache if exists.
@@ -35,19 +89,25 @@ public:
     void emitResponse(uint64_t id);
 
     /**
-     * Add response to the cache. If a response with the same id
-     * is already in the cache it will be replace with the new value.
+     * Remove the response from the cache and execute its callback. The
+     * response and the callback are moved out of the cache, so the
+     * callback runs without holding the slot and without copying the
+     * response. Only the first call for given id executes the callback.
+     */
+    void completeResponse(uint64_t id);
+
+    /**
+     * Add response to the cache.
      * The response will have an automatically assigned unique id.
      */
     uint64_t storeResponse(
         TRes &&value, std::function<void(const TRes &)> callback);
 
     /**
-     * Add a response to the cache with a custom id. The user must
-     * ensure it is unique.
+     * Add response to the cache and return its batch holding a single
+     * reference, which is dropped when the batch is completed.
      */
-    void storeResponse(
-        uint64_t id, TRes &&value, std::function<void(const TRes &)> callback);
+    Batch *storeBatch(TRes &&value, std::function<void(const TRes &)> callback);
 
     /**
      * Return the response for given id.
@@ -60,86 +120,251 @@ public:
     bool hasResponse(uint64_t id);
 
 private:
-    std::unordered_map<uint64_t,
-        std::tuple<TRes, std::function<void(const TRes &)>>>
-        m_responses;
+    static constexpr uint32_t kChunkBits = 8;
+    static constexpr uint32_t kChunkSize = 1u << kChunkBits;
+    static constexpr uint32_t kMaxChunks = 4096;
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    using Chunk = std::array<Batch, kChunkSize>;
+
+    static uint64_t makeId(uint32_t generation, uint32_t index)
+    {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    static uint64_t makeHead(uint32_t tag, uint32_t index)
+    {
+        return (static_cast<uint64_t>(tag) << 32) | index;
+    }
+
+    Batch *slot(uint32_t index) const;
+
+    Batch *find(uint64_t id) const;
+
+    uint32_t claim();
 
-    uint64_t m_responseNextId{0};
+    void recycle(uint32_t index);
 
-    std::mutex m_mutex;
+    void grow();
+
+    std::array<std::atomic<Chunk *>, kMaxChunks> m_chunks{};
+    std::atomic<uint32_t> m_chunkCount{0};
+
+    // Head of the free slot stack, tagged with a counter bumped on every
+    // update to avoid ABA between concurrent claims and releases
+    std::atomic<uint64_t> m_freeHead{makeHead(0, kNoSlot)};
+
+    std::mutex m_growMutex;
 };
 
+template <class TRes> uint64_t ResponsePlaceholder<TRes>::Batch::id() const
+{
+    return makeId(m_generation.load(std::memory_order_acquire), m_index);
+}
+
+template <class TRes> void ResponsePlaceholder<TRes>::Batch::retain()
+{
+    m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class TRes> void ResponsePlaceholder<TRes>::Batch::release()
+{
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    m_value = TRes{};
+    m_callback = nullptr;
+    m_generation.fetch_add(1, std::memory_order_release);
+    m_owner->recycle(m_index);
+}
+
 template <class TRes>
-uint64_t ResponsePlaceholder<TRes>::storeResponse(
-    TRes &&value, std::function<void(const TRes &)> callback)
+bool ResponsePlaceholder<TRes>::Batch::take(
+    TRes &value, std::function<void(const TRes &)> &callback)
+{
+    bool busy = true;
+    if (!m_busy.compare_exchange_strong(
+            busy, false, std::memory_order_acq_rel))
+        return false;
+
+    value = std::move(m_value);
+    callback = std::move(m_callback);
+    release();
+
+    return true;
+}
+
+template <class TRes> void ResponsePlaceholder<TRes>::Batch::complete()
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    TRes value;
+    std::function<void(const TRes &)> callback;
+    if (!take(value, callback))
+        return;
 
     assert(callback);
 
-    uint64_t id = m_responseNextId++;
+    if (callback)
+        callback(value);
+}
 
-    assert(m_responses.find(id) == m_responses.end());
+template <class TRes> ResponsePlaceholder<TRes>::ResponsePlaceholder()
+{
+    grow();
+}
 
-    m_responses.emplace(id,
-        std::make_tuple<TRes, std::function<void(const TRes &)>>(
-            std::move(value), std::move(callback)));
+template <class TRes> ResponsePlaceholder<TRes>::~ResponsePlaceholder()
+{
+    for (uint32_t i = 0; i < m_chunkCount.load(); ++i)
+        delete m_chunks[i].load();
+}
 
-    return id;
+template <class TRes>
+typename ResponsePlaceholder<TRes>::Batch *ResponsePlaceholder<TRes>::slot(
+    uint32_t index) const
+{
+    auto chunk = index >> kChunkBits;
+    if (chunk >= m_chunkCount.load(std::memory_order_acquire))
+        return nullptr;
+
+    return &(*m_chunks[chunk].load(std::memory_order_acquire))[index &
+        (kChunkSize - 1)];
 }
 
 template <class TRes>
-void ResponsePlaceholder<TRes>::storeResponse(
-    uint64_t id, TRes &&value, std::function<void(const TRes &)> callback)
+typename ResponsePlaceholder<TRes>::Batch *ResponsePlaceholder<TRes>::find(
+    uint64_t id) const
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    auto s = slot(static_cast<uint32_t>(id));
+    if (!s || !s->m_busy.load(std::memory_order_acquire) ||
+        s->m_generation.load(std::memory_order_acquire) != (id >> 32))
+        return nullptr;
+
+    return s;
+}
+
+template <class TRes> uint32_t ResponsePlaceholder<TRes>::claim()
+{
+    while (true) {
+        auto head = m_freeHead.load(std::memory_order_acquire);
+        auto index = static_cast<uint32_t>(head);
+        if (index == kNoSlot) {
+            grow();
+            continue;
+        }
+
+        auto next = slot(index)->m_next.load(std::memory_order_relaxed);
+        if (m_freeHead.compare_exchange_weak(head,
+                makeHead(static_cast<uint32_t>(head >> 32) + 1, next),
+                std::memory_order_acq_rel))
+            return index;
+    }
+}
+
+template <class TRes> void ResponsePlaceholder<TRes>::recycle(uint32_t index)
+{
+    auto s = slot(index);
+    auto head = m_freeHead.load(std::memory_order_acquire);
+    do {
+        s->m_next.store(
+            static_cast<uint32_t>(head), std::memory_order_relaxed);
+    } while (!m_freeHead.compare_exchange_weak(head,
+        makeHead(static_cast<uint32_t>(head >> 32) + 1, index),
+        std::memory_order_acq_rel));
+}
+
+template <class TRes> void ResponsePlaceholder<TRes>::grow()
+{
+    std::lock_guard<std::mutex> guard(m_growMutex);
+
+    // Another thread might have already refilled the free slot stack
+    if (static_cast<uint32_t>(m_freeHead.load()) != kNoSlot)
+        return;
+
+    auto chunkIndex = m_chunkCount.load();
+    if (chunkIndex == kMaxChunks)
+        throw std::bad_alloc{};
+
+    auto chunk = new Chunk{};
+    auto first = chunkIndex << kChunkBits;
+    for (uint32_t i = 0; i < kChunkSize; ++i) {
+        (*chunk)[i].m_owner = this;
+        (*chunk)[i].m_index = first + i;
+    }
 
+    m_chunks[chunkIndex].store(chunk, std::memory_order_release);
+    m_chunkCount.store(chunkIndex + 1, std::memory_order_release);
+
+    for (uint32_t i = kChunkSize; i > 0; --i)
+        recycle(first + i - 1);
+}
+
+template <class TRes>
+typename ResponsePlaceholder<TRes>::Batch *
+ResponsePlaceholder<TRes>::storeBatch(
+    TRes &&value, std::function<void(const TRes &)> callback)
+{
     assert(callback);
 
-    assert(m_responses.find(id) == m_responses.end());
+    auto s = slot(claim());
+
+    s->m_value = std::move(value);
+    s->m_callback = std::move(callback);
+    s->m_refs.store(1, std::memory_order_relaxed);
+    s->m_busy.store(true, std::memory_order_release);
 
-    m_responses.emplace(id,
-        std::make_tuple<TRes, std::function<void(const TRes &)>>(
-            std::move(value), std::move(callback)));
+    return s;
 }
 
-template <class TRes> bool ResponsePlaceholder<TRes>::hasResponse(uint64_t id)
+template <class TRes>
+uint64_t ResponsePlaceholder<TRes>::storeResponse(
+    TRes &&value, std::function<void(const TRes &)> callback)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    return storeBatch(std::move(value), std::move(callback))->id();
+}
 
-    return m_responses.find(id) != m_responses.end();
+template <class TRes> bool ResponsePlaceholder<TRes>::hasResponse(uint64_t id)
+{
+    return find(id) != nullptr;
 }
 
 template <class TRes> TRes &ResponsePlaceholder<TRes>::getResponse(uint64_t id)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    auto s = find(id);
 
-    assert(m_responses.find(id) != m_responses.end());
+    assert(s);
 
-    return std::get<0>(m_responses[id]);
+    return s->m_value;
 }
 
 template <class TRes>
 void ResponsePlaceholder<TRes>::forgetResponse(uint64_t id)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    auto s = find(id);
+    if (!s)
+        return;
 
-    m_responses.erase(id);
+    TRes value;
+    std::function<void(const TRes &)> callback;
+    s->take(value, callback);
 }
 
 template <class TRes> void ResponsePlaceholder<TRes>::emitResponse(uint64_t id)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
-
-    assert(m_responses.find(id) != m_responses.end());
+    auto s = find(id);
 
-    auto response = std::get<0>(m_responses[id]);
-    auto callback = std::get<1>(m_responses[id]);
+    assert(s);
+    assert(s->m_callback);
 
-    assert(callback);
+    if (s && s->m_callback)
+        s->m_callback(s->m_value);
+}
 
-    if (callback)
-        callback(response);
+template <class TRes>
+void ResponsePlaceholder<TRes>::completeResponse(uint64_t id)
+{
+    auto s = find(id);
+    if (s)
+        s->complete();
 }
 }
 
@@ -27,7 +27,7 @@ nifpp::TERM ConnectResponse::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
         return nifpp::make(env,
-            std::make_tuple(nifpp::str_atom{"ok"},
+            std::make_tuple(okAtom(),
                 nifpp::construct_resource<ConnectionPtr>(m_connection)));
     }
 
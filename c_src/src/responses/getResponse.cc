@@ -7,6 +7,17 @@
 
 #include "getResponse.h"
 
+#if !defined(NO_ERLANG)
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#endif
+
 namespace cb {
 
 GetResponse::GetResponse(lcb_error_t err, const void *key, std::size_t keySize)
@@ -16,26 +27,514 @@ GetResponse::GetResponse(lcb_error_t err, const void *key, std::size_t keySize)
 }
 
 GetResponse::GetResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
-    lcb_uint32_t flags, const void *value, std::size_t valueSize)
+    lcb_uint32_t flags, const void *value, std::size_t valueSize,
+    bool decodeJson, bool replica)
     : Response{LCB_SUCCESS}
     , m_key{static_cast<const char *>(key), keySize}
     , m_cas{cas}
     , m_flags{flags}
     , m_value{static_cast<const char *>(value), valueSize}
+    , m_decodeJson{decodeJson && flags == kJsonFlags}
+    , m_replica{replica}
+{
+}
+
+GetResponse::GetResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
+    lcb_uint32_t flags, const void *value, std::size_t valueSize,
+    BufferPtr buffer, bool replica)
+    : Response{LCB_SUCCESS}
+    , m_key{static_cast<const char *>(key), keySize}
+    , m_cas{cas}
+    , m_flags{flags}
+    , m_value{static_cast<const char *>(value), valueSize}
+    , m_buffer{std::move(buffer)}
+    , m_replica{replica}
+{
+}
+
+void GetResponse::copyInto(Arena &arena)
 {
+    m_key = arena.copy(m_key.data(), m_key.size());
+    if (!m_buffer)
+        m_value = arena.copy(m_value.data(), m_value.size());
+}
+
+std::size_t GetResponse::binarySize() const
+{
+    // A JSON value is counted in case it has to be passed undecoded
+    return m_key.size() + (m_buffer ? 0 : m_value.size());
 }
 
 #if !defined(NO_ERLANG)
-nifpp::TERM GetResponse::toTerm(const Env &env) const
+nifpp::TERM GetResponse::toTerm(const Env &env, BatchBinary &binary) const
 {
-    if (m_err == LCB_SUCCESS) {
+    if (m_err != LCB_SUCCESS) {
+        return nifpp::make(
+            env, std::make_tuple(binary.add(m_key), Response::toTerm(env)));
+    }
+
+    // Decoded values are marked with 'json' in place of the flags
+    folly::Optional<nifpp::TERM> json;
+    if (m_decodeJson)
+        json = jsonToTerm(env);
+
+    auto flags = json ? nifpp::make(env, nifpp::str_atom{"json"})
+                      : nifpp::make(env, m_flags);
+    auto value = json ? *json : valueToTerm(env, binary);
+
+    // Values read from a replica are marked with a trailing 'replica'
+    if (m_replica) {
         return nifpp::make(env,
-            std::make_tuple(m_key,
-                std::make_tuple(
-                    nifpp::str_atom{"ok"}, m_cas, m_flags, m_value)));
+            std::make_tuple(binary.add(m_key),
+                std::make_tuple(okAtom(), m_cas, flags, value,
+                    nifpp::str_atom{"replica"})));
+    }
+
+    return nifpp::make(env,
+        std::make_tuple(
+            binary.add(m_key), std::make_tuple(okAtom(), m_cas, flags, value)));
+}
+
+nifpp::TERM GetResponse::valueToTerm(const Env &env, BatchBinary &binary) const
+{
+    if (!m_buffer)
+        return binary.add(m_value);
+
+    // The binary keeps the resource, and so the buffer, alive until it is
+    // garbage collected
+    auto resource = nifpp::construct_resource<BufferPtr>(m_buffer);
+    return nifpp::TERM{enif_make_resource_binary(
+        env, resource.get(), m_value.data(), m_value.size())};
+}
+
+namespace {
+
+/**
+ * @c JsonDecoder decodes a JSON document straight into terms in the
+ * format of jiffy, with fields of objects in document order. Documents
+ * left for jiffy to decode or reject, e.g. invalid ones or those with
+ * integers beyond 64 bits, make it throw.
+ */
+class JsonDecoder {
+public:
+    JsonDecoder(ErlNifEnv *env, folly::StringPiece json)
+        : m_env{env}
+        , m_pos{json.begin()}
+        , m_end{json.end()}
+    {
+    }
+
+    ERL_NIF_TERM decode()
+    {
+        auto term = value(0);
+        skipSpace();
+        if (m_pos != m_end)
+            fail();
+
+        return term;
+    }
+
+private:
+    // Bounds the recursion on the stack of the IO thread
+    static constexpr unsigned kMaxDepth = 512;
+
+    [[noreturn]] static void fail()
+    {
+        throw std::invalid_argument{"unsupported JSON"};
+    }
+
+    void skipSpace()
+    {
+        while (m_pos != m_end &&
+            (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' ||
+                *m_pos == '\t'))
+            ++m_pos;
+    }
+
+    bool consume(char c)
+    {
+        skipSpace();
+        if (m_pos == m_end || *m_pos != c)
+            return false;
+
+        ++m_pos;
+        return true;
     }
 
-    return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail();
+    }
+
+    ERL_NIF_TERM value(unsigned depth)
+    {
+        if (depth > kMaxDepth)
+            fail();
+
+        skipSpace();
+        if (m_pos == m_end)
+            fail();
+
+        switch (*m_pos) {
+            case '{':
+                return object(depth);
+            case '[':
+                return array(depth);
+            case '"':
+                return string();
+            case 't':
+                return literal("true");
+            case 'f':
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                return number();
+        }
+    }
+
+    ERL_NIF_TERM object(unsigned depth)
+    {
+        ++m_pos;
+        std::vector<ERL_NIF_TERM> fields;
+        if (!consume('}')) {
+            do {
+                skipSpace();
+                if (m_pos == m_end || *m_pos != '"')
+                    fail();
+
+                auto key = string();
+                expect(':');
+                fields.push_back(
+                    enif_make_tuple2(m_env, key, value(depth + 1)));
+            } while (consume(','));
+            expect('}');
+        }
+
+        return enif_make_tuple1(m_env,
+            enif_make_list_from_array(m_env, fields.data(), fields.size()));
+    }
+
+    ERL_NIF_TERM array(unsigned depth)
+    {
+        ++m_pos;
+        std::vector<ERL_NIF_TERM> elements;
+        if (!consume(']')) {
+            do {
+                elements.push_back(value(depth + 1));
+            } while (consume(','));
+            expect(']');
+        }
+
+        return enif_make_list_from_array(
+            m_env, elements.data(), elements.size());
+    }
+
+    ERL_NIF_TERM string()
+    {
+        ++m_pos;
+
+        // Strings without escapes are copied as they are
+        auto start = m_pos;
+        while (m_pos != m_end && *m_pos != '"' && *m_pos != '\\') {
+            if (static_cast<unsigned char>(*m_pos) < 0x20)
+                fail();
+            ++m_pos;
+        }
+
+        if (m_pos == m_end)
+            fail();
+
+        if (*m_pos == '"') {
+            folly::StringPiece str{start, m_pos++};
+            validateUtf8(str);
+            return binary(str);
+        }
+
+        m_string.assign(start, m_pos);
+        while (true) {
+            if (m_pos == m_end || static_cast<unsigned char>(*m_pos) < 0x20)
+                fail();
+
+            auto c = *m_pos++;
+            if (c == '"')
+                break;
+
+            if (c != '\\') {
+                m_string.push_back(c);
+                continue;
+            }
+
+            if (m_pos == m_end)
+                fail();
+
+            switch (*m_pos++) {
+                case '"':
+                    m_string.push_back('"');
+                    break;
+                case '\\':
+                    m_string.push_back('\\');
+                    break;
+                case '/':
+                    m_string.push_back('/');
+                    break;
+                case 'b':
+                    m_string.push_back('\b');
+                    break;
+                case 'f':
+                    m_string.push_back('\f');
+                    break;
+                case 'n':
+                    m_string.push_back('\n');
+                    break;
+                case 'r':
+                    m_string.push_back('\r');
+                    break;
+                case 't':
+                    m_string.push_back('\t');
+                    break;
+                case 'u':
+                    appendUtf8(codePoint());
+                    break;
+                default:
+                    fail();
+            }
+        }
+
+        validateUtf8(m_string);
+        return binary(m_string);
+    }
+
+    /**
+     * Reads the code point of a \\u escape, joining surrogate pairs.
+     */
+    std::uint32_t codePoint()
+    {
+        auto unit = hex4();
+        if (unit >= 0xDC00 && unit <= 0xDFFF)
+            fail();
+
+        if (unit < 0xD800 || unit > 0xDBFF)
+            return unit;
+
+        if (m_end - m_pos < 2 || m_pos[0] != '\\' || m_pos[1] != 'u')
+            fail();
+
+        m_pos += 2;
+        auto low = hex4();
+        if (low < 0xDC00 || low > 0xDFFF)
+            fail();
+
+        return 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    std::uint32_t hex4()
+    {
+        if (m_end - m_pos < 4)
+            fail();
+
+        std::uint32_t unit = 0;
+        for (int i = 0; i < 4; ++i) {
+            auto c = *m_pos++;
+            unit <<= 4;
+            if (c >= '0' && c <= '9')
+                unit |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                unit |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                unit |= c - 'A' + 10;
+            else
+                fail();
+        }
+
+        return unit;
+    }
+
+    void appendUtf8(std::uint32_t cp)
+    {
+        if (cp < 0x80) {
+            m_string.push_back(static_cast<char>(cp));
+        }
+        else if (cp < 0x800) {
+            m_string.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            m_string.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000) {
+            m_string.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            m_string.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            m_string.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+        else {
+            m_string.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            m_string.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            m_string.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            m_string.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    /**
+     * Rejects invalid UTF-8, as jiffy does.
+     */
+    static void validateUtf8(folly::StringPiece str)
+    {
+        auto it = reinterpret_cast<const unsigned char *>(str.begin());
+        auto end = reinterpret_cast<const unsigned char *>(str.end());
+        while (it != end) {
+            if (*it < 0x80) {
+                ++it;
+                continue;
+            }
+
+            int length;
+            std::uint32_t cp;
+            if ((*it & 0xE0) == 0xC0) {
+                length = 2;
+                cp = *it & 0x1F;
+            }
+            else if ((*it & 0xF0) == 0xE0) {
+                length = 3;
+                cp = *it & 0x0F;
+            }
+            else if ((*it & 0xF8) == 0xF0) {
+                length = 4;
+                cp = *it & 0x07;
+            }
+            else {
+                fail();
+            }
+
+            if (end - it < length)
+                fail();
+
+            for (int i = 1; i < length; ++i) {
+                if ((it[i] & 0xC0) != 0x80)
+                    fail();
+                cp = (cp << 6) | (it[i] & 0x3F);
+            }
+
+            // Overlong encodings, surrogates and code points beyond Unicode
+            static const std::uint32_t minimum[] = {0, 0, 0x80, 0x800, 0x10000};
+            if (cp < minimum[length] || cp > 0x10FFFF ||
+                (cp >= 0xD800 && cp <= 0xDFFF))
+                fail();
+
+            it += length;
+        }
+    }
+
+    ERL_NIF_TERM number()
+    {
+        auto start = m_pos;
+        bool integer = true;
+
+        if (m_pos != m_end && *m_pos == '-')
+            ++m_pos;
+
+        if (m_pos != m_end && *m_pos == '0')
+            ++m_pos;
+        else if (!digits())
+            fail();
+
+        if (m_pos != m_end && *m_pos == '.') {
+            ++m_pos;
+            integer = false;
+            if (!digits())
+                fail();
+        }
+
+        if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E')) {
+            ++m_pos;
+            integer = false;
+            if (m_pos != m_end && (*m_pos == '+' || *m_pos == '-'))
+                ++m_pos;
+            if (!digits())
+                fail();
+        }
+
+        if (integer)
+            return integerTerm(start);
+
+        m_string.assign(start, m_pos);
+        return enif_make_double(m_env, std::strtod(m_string.c_str(), nullptr));
+    }
+
+    bool digits()
+    {
+        auto start = m_pos;
+        while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+            ++m_pos;
+
+        return m_pos != start;
+    }
+
+    /**
+     * Makes the integer, unless it does not fit into 64 bits.
+     */
+    ERL_NIF_TERM integerTerm(const char *it)
+    {
+        bool negative = *it == '-';
+        if (negative)
+            ++it;
+
+        // Accumulated as a negative number, which has the larger range
+        std::int64_t value = 0;
+        for (; it != m_pos; ++it) {
+            int digit = *it - '0';
+            if (value < (std::numeric_limits<std::int64_t>::min() + digit) / 10)
+                fail();
+            value = value * 10 - digit;
+        }
+
+        if (!negative) {
+            if (value == std::numeric_limits<std::int64_t>::min())
+                fail();
+            value = -value;
+        }
+
+        return enif_make_int64(m_env, value);
+    }
+
+    ERL_NIF_TERM literal(const char *word)
+    {
+        auto size = std::strlen(word);
+        if (static_cast<std::size_t>(m_end - m_pos) < size ||
+            std::memcmp(m_pos, word, size) != 0)
+            fail();
+
+        m_pos += size;
+        return enif_make_atom(m_env, word);
+    }
+
+    ERL_NIF_TERM binary(folly::StringPiece str)
+    {
+        ERL_NIF_TERM term;
+        std::memcpy(enif_make_new_binary(m_env, str.size(), &term),
+            str.data(), str.size());
+        return term;
+    }
+
+    ErlNifEnv *m_env;
+    const char *m_pos;
+    const char *m_end;
+
+    // Unescaped strings and numbers being converted
+    std::string m_string;
+};
+
+constexpr unsigned JsonDecoder::kMaxDepth;
+
+} // namespace
+
+folly::Optional<nifpp::TERM> GetResponse::jsonToTerm(const Env &env) const
+{
+    try {
+        return nifpp::TERM{JsonDecoder{env, m_value}.decode()};
+    }
+    catch (const std::exception &) {
+        // Left for jiffy, e.g. integers beyond 64 bits
+        return folly::none;
+    }
 }
 #endif
 
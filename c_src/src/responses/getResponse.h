@@ -8,26 +8,73 @@
 #ifndef CBERL_GET_RESPONSE_H
 #define CBERL_GET_RESPONSE_H
 
+#include "arena.h"
 #include "response.h"
+#include "types.h"
+
+#include <folly/Optional.h>
 
 namespace cb {
 
+/**
+ * Flags of values stored as JSON.
+ */
+constexpr lcb_uint32_t kJsonFlags = 1;
+
 class GetResponse : public Response {
 public:
     GetResponse(lcb_error_t err, const void *key, std::size_t keySize);
 
+    /**
+     * Creates a response with a value. A JSON value is passed to Erlang
+     * decoded, if @c decodeJson is set. Values read from a replica are
+     * marked as such with @c replica.
+     */
+    GetResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
+        lcb_uint32_t flags, const void *value, std::size_t valueSize,
+        bool decodeJson = false, bool replica = false);
+
+    /**
+     * Creates a response referencing the value in @c buffer instead of
+     * copying it.
+     */
     GetResponse(const void *key, std::size_t keySize, lcb_cas_t cas,
-        lcb_uint32_t flags, const void *value, std::size_t valueSize);
+        lcb_uint32_t flags, const void *value, std::size_t valueSize,
+        BufferPtr buffer, bool replica = false);
+
+    /**
+     * Copies the key and the value into @c arena, so that the response
+     * no longer references memory owned by libcouchbase.
+     */
+    void copyInto(Arena &arena);
+
+    /**
+     * Returns the number of bytes the response adds to the batch binary.
+     */
+    std::size_t binarySize() const;
 
 #if !defined(NO_ERLANG)
-    nifpp::TERM toTerm(const Env &env) const;
+    nifpp::TERM toTerm(const Env &env, BatchBinary &binary) const;
 #endif
 
 private:
-    std::string m_key;
+#if !defined(NO_ERLANG)
+    nifpp::TERM valueToTerm(const Env &env, BatchBinary &binary) const;
+
+    /**
+     * Returns the value decoded as JSON, in the format of jiffy, or
+     * nothing if it is left for jiffy to decode.
+     */
+    folly::Optional<nifpp::TERM> jsonToTerm(const Env &env) const;
+#endif
+
+    folly::StringPiece m_key;
     lcb_cas_t m_cas;
     lcb_uint32_t m_flags;
-    std::string m_value;
+    folly::StringPiece m_value;
+    BufferPtr m_buffer;
+    bool m_decodeJson{false};
+    bool m_replica{false};
 };
 
 } // namespace cb
@@ -8,46 +8,333 @@
 #ifndef CBERL_MULTI_RESPONSE_H
 #define CBERL_MULTI_RESPONSE_H
 
+#include "arena.h"
 #include "response.h"
+#include "types.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <utility>
 #include <vector>
 
 namespace cb {
 
+template <class ResponseT> class MultiResponse;
+
+/**
+ * Streaming options of a batch. Responses of a streamed batch are handed
+ * to @c onChunk in chunks of @c chunkSize responses, or every
+ * @c interval if it is not zero, instead of all at once on completion.
+ * The completion callback receives only the responses left over since
+ * the last chunk.
+ */
+template <class ResponseT> struct Stream {
+    std::size_t chunkSize;
+    std::chrono::microseconds interval;
+    Callback<MultiResponse<ResponseT>> onChunk;
+};
+
+template <class ResponseT>
+using StreamPtr = std::shared_ptr<const Stream<ResponseT>>;
+
+/**
+ * @c MultiResponse collects responses of a single batch.
+ *
+ * Small batches are encoded straight into the batch environment as the
+ * responses arrive, so sending the result is just wrapping a list that
+ * is already built. Larger batches keep response records, with their
+ * keys and values copied into an @c Arena, and encode all of them at
+ * once in @c toTerm, sharing a single binary. Streamed batches are
+ * always encoded as the responses arrive, as each chunk is sent and
+ * released on its own.
+ */
 template <class ResponseT> class MultiResponse : public Response {
 public:
-    MultiResponse(lcb_error_t err = LCB_SUCCESS, uint64_t batchSize = 1)
+    MultiResponse() = default;
+
+    MultiResponse(lcb_error_t err, uint64_t batchSize = 1,
+        StreamPtr<ResponseT> stream = nullptr)
         : Response{err}
         , m_batchSize{batchSize}
+        , m_stream{std::move(stream)}
     {
+        auto capacity = m_stream
+            ? std::min<uint64_t>(batchSize, m_stream->chunkSize)
+            : batchSize;
+#if !defined(NO_ERLANG)
+        m_env = Env{};
+        if (m_stream || batchSize <= kEncodedBatchSize) {
+            m_encoded = true;
+            m_terms.reserve(capacity);
+            return;
+        }
+#endif
+        resetResponses(capacity);
     }
 
-    void add(ResponseT response)
+    MultiResponse(const MultiResponse<ResponseT> &) = default;
+
+    MultiResponse(MultiResponse<ResponseT> &&) = default;
+
+    // Responses are always released before the arenas backing them
+    MultiResponse &operator=(MultiResponse<ResponseT> other)
     {
-        m_responses.emplace_back(std::move(response));
+        std::swap(m_err, other.m_err);
+        m_arenas.swap(other.m_arenas);
+        m_responses.swap(other.m_responses);
+        std::swap(m_batchSize, other.m_batchSize);
+        std::swap(m_received, other.m_received);
+        std::swap(m_expired, other.m_expired);
+        m_abandoned.swap(other.m_abandoned);
+        m_stream.swap(other.m_stream);
+#if !defined(NO_ERLANG)
+        std::swap(m_env, other.m_env);
+        m_terms.swap(other.m_terms);
+        std::swap(m_encoded, other.m_encoded);
+#endif
+        return *this;
     }
 
-    bool complete() { return m_responses.size() == m_batchSize; }
+    template <class... Args> void add(Args &&... args)
+    {
+        ++m_received;
+        if (!m_expired && m_abandoned &&
+            m_abandoned->load(std::memory_order_relaxed))
+            expire();
+        if (m_expired)
+            return;
 
+        ResponseT response{std::forward<Args>(args)...};
 #if !defined(NO_ERLANG)
-    nifpp::TERM toTerm(const Env &env) const
+        if (m_encoded) {
+            BatchBinary binary{m_env};
+            m_terms.emplace_back(response.toTerm(m_env, binary));
+        }
+        else
+#endif
+        {
+            response.copyInto(*m_arenas.front());
+            m_responses.emplace_back(std::move(response));
+        }
+
+        // The last chunk is left for the completion callback
+        if (m_stream && size() >= m_stream->chunkSize && !complete()) {
+            flush();
+        }
+    }
+
+    bool complete() { return m_received == m_batchSize; }
+
+    /**
+     * Marks the batch expired, as its caller no longer waits for it. The
+     * responses received so far are released and further responses are
+     * only counted, so that the batch still completes, but nothing is
+     * encoded for it anymore.
+     */
+    void expire()
+    {
+        m_expired = true;
+        m_err = LCB_ETIMEDOUT;
+#if !defined(NO_ERLANG)
+        if (m_encoded) {
+            m_terms.clear();
+            if (m_env)
+                enif_clear_env(m_env);
+            return;
+        }
+#endif
+        resetResponses(0);
+    }
+
+    bool expired() const { return m_expired; }
+
+    /**
+     * Watches the flag raised once the caller of the batch is gone, after
+     * which the batch expires with its next response.
+     */
+    void setAbandoned(std::shared_ptr<const std::atomic<bool>> abandoned)
+    {
+        m_abandoned = std::move(abandoned);
+    }
+
+    /**
+     * Returns the streaming options of the batch, if it is streamed.
+     */
+    const StreamPtr<ResponseT> &stream() const { return m_stream; }
+
+    /**
+     * Hands the responses received since the last chunk to the stream
+     * and releases them.
+     */
+    void flush()
+    {
+        if (!m_stream || size() == 0) {
+            return;
+        }
+
+        m_stream->onChunk(*this);
+
+#if !defined(NO_ERLANG)
+        // Sending the chunk has invalidated the terms of the environment
+        m_terms.clear();
+        enif_clear_env(m_env);
+#else
+        resetResponses(m_stream->chunkSize);
+#endif
+    }
+
+    /**
+     * Appends responses of another batch. The first error reported by
+     * any of the merged batches becomes the error of this batch, which
+     * expires with any of them.
+     */
+    void merge(const MultiResponse<ResponseT> &other)
     {
         if (m_err == LCB_SUCCESS) {
-            std::vector<nifpp::TERM> terms;
-            for (const auto &response : m_responses) {
-                terms.emplace_back(response.toTerm(env));
+            m_err = other.m_err;
+        }
+        m_batchSize += other.m_batchSize;
+        m_received += other.m_received;
+
+        if (other.m_expired && !m_expired) {
+            expire();
+        }
+        if (m_expired) {
+            return;
+        }
+
+#if !defined(NO_ERLANG)
+        // Merged responses are always encoded, so that the result can be
+        // sent from a single environment
+        assert(m_encoded || m_responses.empty());
+        if (!m_env) {
+            m_env = Env{};
+        }
+        m_encoded = true;
+
+        if (other.m_encoded) {
+            for (auto term : other.m_terms) {
+                m_terms.push_back(enif_make_copy(m_env, term));
             }
-            return nifpp::make(
-                env, std::make_tuple(nifpp::str_atom{"ok"}, std::move(terms)));
         }
+        else {
+            BatchBinary binary{m_env, other.binarySize()};
+            for (const auto &response : other.m_responses) {
+                m_terms.emplace_back(response.toTerm(m_env, binary));
+            }
+        }
+#else
+        m_arenas.insert(
+            m_arenas.end(), other.m_arenas.begin(), other.m_arenas.end());
+        m_responses.insert(m_responses.end(), other.m_responses.begin(),
+            other.m_responses.end());
+#endif
+    }
+
+#if !defined(NO_ERLANG)
+    /**
+     * Returns the environment of the batch. Encoding and sending the
+     * response in this environment avoids copying encoded responses.
+     */
+    const Env &env() const { return m_env; }
 
-        return Response::toTerm(env);
+    nifpp::TERM toTerm(const Env &env) const
+    {
+        if (m_err != LCB_SUCCESS) {
+            return Response::toTerm(env);
+        }
+
+        return nifpp::TERM{enif_make_tuple2(env, okAtom(), listToTerm(env))};
+    }
+
+    /**
+     * Returns responses received since the last chunk of a streamed
+     * batch as a @c {partial, Responses} tuple.
+     */
+    nifpp::TERM chunkToTerm(const Env &env) const
+    {
+        return nifpp::TERM{enif_make_tuple2(
+            env, enif_make_atom(env, "partial"), listToTerm(env))};
     }
 #endif
 
+    /**
+     * Checks whether any responses were received since the last chunk.
+     */
+    bool empty() const { return size() == 0; }
+
 private:
-    std::vector<ResponseT> m_responses;
-    uint64_t m_batchSize;
+    using Responses = std::vector<ResponseT, ArenaAllocator<ResponseT>>;
+
+    // Batches up to this size are encoded as their responses arrive
+    static constexpr uint64_t kEncodedBatchSize = 256;
+
+    std::size_t size() const
+    {
+#if !defined(NO_ERLANG)
+        if (m_encoded)
+            return m_terms.size();
+#endif
+        return m_responses.size();
+    }
+
+    void resetResponses(std::size_t capacity)
+    {
+        m_responses = Responses{};
+        m_arenas.clear();
+        m_arenas.emplace_back(Arena::acquire());
+        m_responses = Responses{
+            ArenaAllocator<ResponseT>{m_arenas.front().get()}};
+        m_responses.reserve(capacity);
+    }
+
+#if !defined(NO_ERLANG)
+    ERL_NIF_TERM listToTerm(const Env &env) const
+    {
+        if (m_encoded) {
+            auto list = enif_make_list_from_array(
+                m_env, m_terms.data(), m_terms.size());
+            if (env.get() != m_env.get()) {
+                list = enif_make_copy(env, list);
+            }
+            return list;
+        }
+
+        BatchBinary binary{env, binarySize()};
+        std::vector<ERL_NIF_TERM> terms;
+        terms.reserve(m_responses.size());
+        for (const auto &response : m_responses) {
+            terms.emplace_back(response.toTerm(env, binary));
+        }
+        return enif_make_list_from_array(env, terms.data(), terms.size());
+    }
+#endif
+
+    std::size_t binarySize() const
+    {
+        std::size_t size = 0;
+        for (const auto &response : m_responses) {
+            size += response.binarySize();
+        }
+        return size;
+    }
+
+    std::vector<ArenaPtr> m_arenas;
+    Responses m_responses;
+    uint64_t m_batchSize{0};
+    uint64_t m_received{0};
+    bool m_expired{false};
+    std::shared_ptr<const std::atomic<bool>> m_abandoned;
+    StreamPtr<ResponseT> m_stream;
+
+#if !defined(NO_ERLANG)
+    Env m_env{nullptr};
+    std::vector<ERL_NIF_TERM> m_terms;
+    bool m_encoded{false};
+#endif
 };
 
 } // namespace cb
@@ -16,14 +16,23 @@ RemoveResponse::RemoveResponse(
 {
 }
 
+void RemoveResponse::copyInto(Arena &arena)
+{
+    m_key = arena.copy(m_key.data(), m_key.size());
+}
+
+std::size_t RemoveResponse::binarySize() const { return m_key.size(); }
+
 #if !defined(NO_ERLANG)
-nifpp::TERM RemoveResponse::toTerm(const Env &env) const
+nifpp::TERM RemoveResponse::toTerm(const Env &env, BatchBinary &binary) const
 {
     if (m_err == LCB_SUCCESS) {
-        return nifpp::make(env, std::make_tuple(m_key, nifpp::str_atom{"ok"}));
+        return nifpp::make(env,
+            std::make_tuple(binary.add(m_key), okAtom()));
     }
 
-    return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
+    return nifpp::make(
+        env, std::make_tuple(binary.add(m_key), Response::toTerm(env)));
 }
 #endif
 
@@ -8,6 +8,7 @@
 #ifndef CBERL_REMOVE_RESPONSE_H
 #define CBERL_REMOVE_RESPONSE_H
 
+#include "arena.h"
 #include "response.h"
 
 namespace cb {
@@ -16,12 +17,23 @@ class RemoveResponse : public Response {
 public:
     RemoveResponse(lcb_error_t err, const void *key, std::size_t keySize);
 
+    /**
+     * Copies the key into @c arena, so that the response no longer
+     * references memory owned by libcouchbase.
+     */
+    void copyInto(Arena &arena);
+
+    /**
+     * Returns the number of bytes the response adds to the batch binary.
+     */
+    std::size_t binarySize() const;
+
 #if !defined(NO_ERLANG)
-    nifpp::TERM toTerm(const Env &env) const;
+    nifpp::TERM toTerm(const Env &env, BatchBinary &binary) const;
 #endif
 
 private:
-    std::string m_key;
+    folly::StringPiece m_key;
 };
 
 } // namespace cb
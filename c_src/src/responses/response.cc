@@ -7,8 +7,112 @@
 
 #include "response.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if !defined(NO_ERLANG)
+namespace {
+
+constexpr std::size_t kMaxPooledEnvs = 64;
+constexpr std::size_t kMaxSharedEnvs = 1024;
+
+// Environments taken from the shared pool at once
+constexpr std::size_t kSharedEnvBatch = 16;
+
+/**
+ * Cleared environments of a thread, freed when the thread exits.
+ */
+struct EnvPool {
+    ~EnvPool()
+    {
+        for (auto env : envs)
+            enif_free_env(env);
+    }
+
+    std::vector<ErlNifEnv *> envs;
+};
+
+/**
+ * Cleared environments overflowing the pools of threads that release
+ * more environments than they acquire, e.g. IO threads releasing the
+ * environments of requests decoded on schedulers. Other threads refill
+ * their pools from it.
+ */
+struct SharedEnvPool {
+    std::mutex mutex;
+    std::vector<ErlNifEnv *> envs;
+};
+
+EnvPool &envPool()
+{
+    thread_local EnvPool pool;
+    return pool;
+}
+
+SharedEnvPool &sharedEnvPool()
+{
+    // Never destroyed, as environments must not be freed after the NIF
+    // library is unloaded
+    static auto pool = new SharedEnvPool;
+    return *pool;
+}
+}
+
+std::shared_ptr<ErlNifEnv> Env::acquire()
+{
+    auto &envs = envPool().envs;
+    if (envs.empty()) {
+        auto &shared = sharedEnvPool();
+        std::lock_guard<std::mutex> guard{shared.mutex};
+        auto count = std::min(shared.envs.size(), kSharedEnvBatch);
+        envs.insert(envs.end(), shared.envs.end() - count, shared.envs.end());
+        shared.envs.resize(shared.envs.size() - count);
+    }
+
+    if (envs.empty())
+        return {enif_alloc_env(), &Env::recycle};
+
+    auto env = envs.back();
+    envs.pop_back();
+    return {env, &Env::recycle};
+}
+
+void Env::recycle(ErlNifEnv *env)
+{
+    enif_clear_env(env);
+
+    auto &envs = envPool().envs;
+    if (envs.size() < kMaxPooledEnvs) {
+        envs.push_back(env);
+        return;
+    }
+
+    auto &shared = sharedEnvPool();
+    {
+        std::lock_guard<std::mutex> guard{shared.mutex};
+        if (shared.envs.size() < kMaxSharedEnvs) {
+            shared.envs.push_back(env);
+            return;
+        }
+    }
+
+    enif_free_env(env);
+}
+#endif
+
 namespace cb {
 
+#if !defined(NO_ERLANG)
+namespace {
+ERL_NIF_TERM okTerm;
+ERL_NIF_TERM errorTerm;
+std::array<ERL_NIF_TERM, LCB_MAX_ERROR + 1> errorTerms;
+}
+#endif
+
 Response::Response(lcb_error_t err)
     : m_err{err}
 {
@@ -22,18 +126,62 @@ lcb_error_t Response::error() const { return m_err; }
 nifpp::TERM Response::toTerm(const Env &env) const
 {
     if (m_err == LCB_SUCCESS) {
-        return nifpp::make(env, nifpp::str_atom{"ok"});
+        return okAtom();
+    }
+
+    auto reason = m_err >= 0 && m_err < LCB_MAX_ERROR
+        ? errorTerms[m_err]
+        : errorTerms[LCB_MAX_ERROR];
+
+    return nifpp::TERM{enif_make_tuple2(env, errorTerm, reason)};
+}
+
+void Response::loadAtoms(ErlNifEnv *env)
+{
+    okTerm = enif_make_atom(env, "ok");
+    errorTerm = enif_make_atom(env, "error");
+    for (int err = 0; err <= LCB_MAX_ERROR; ++err) {
+        errorTerms[err] = enif_make_atom(
+            env, errorMessage(static_cast<lcb_error_t>(err)).c_str());
+    }
+}
+
+nifpp::TERM Response::okAtom() { return nifpp::TERM{okTerm}; }
+
+#endif
+
+#if !defined(NO_ERLANG)
+BatchBinary::BatchBinary(const Env &env, std::size_t size)
+    : m_env{env}
+{
+    m_data = enif_make_new_binary(m_env, size, &m_binary);
+}
+
+BatchBinary::BatchBinary(const Env &env)
+    : m_env{env}
+{
+}
+
+nifpp::TERM BatchBinary::add(folly::StringPiece data)
+{
+    if (!m_data) {
+        ERL_NIF_TERM term;
+        std::memcpy(enif_make_new_binary(m_env, data.size(), &term),
+            data.data(), data.size());
+        return nifpp::TERM{term};
     }
 
-    return nifpp::make(env,
-        std::make_tuple(
-            nifpp::str_atom{"error"}, nifpp::str_atom{errorMessage()}));
+    std::memcpy(m_data + m_offset, data.data(), data.size());
+    auto term =
+        enif_make_sub_binary(m_env, m_binary, m_offset, data.size());
+    m_offset += data.size();
+    return nifpp::TERM{term};
 }
 #endif
 
-std::string Response::errorMessage() const
+std::string Response::errorMessage(lcb_error_t err)
 {
-    switch (m_err) {
+    switch (err) {
         case LCB_AUTH_CONTINUE:
             return "auth_continue";
         case LCB_AUTH_ERROR:
@@ -10,24 +10,49 @@
 
 #include "nifpp.h"
 
+#include <folly/Range.h>
 #include <libcouchbase/couchbase.h>
 
 #include <memory>
 #include <string>
 
 #if !defined(NO_ERLANG)
+/**
+ * @c Env is a shared handle to a process independent environment.
+ * Environments are recycled through a per-thread pool; an environment
+ * is cleared when its last handle is released and reused by the next
+ * handle created on the releasing thread. Threads releasing more
+ * environments than they acquire pass the surplus on to other threads
+ * through a shared pool.
+ */
 class Env {
 public:
     Env()
-        : m_env{enif_alloc_env(), enif_free_env}
+        : m_env{acquire()}
     {
     }
 
+    /**
+     * Creates an empty handle, not backed by any environment.
+     */
+    Env(std::nullptr_t) {}
+
+    explicit operator bool() const { return static_cast<bool>(m_env); }
+
     operator ErlNifEnv *() const { return m_env.get(); }
 
     ErlNifEnv *get() const { return m_env.get(); }
 
+    /**
+     * Returns the environment as a pointer sharing its ownership.
+     */
+    const std::shared_ptr<ErlNifEnv> &shared() const { return m_env; }
+
 private:
+    static std::shared_ptr<ErlNifEnv> acquire();
+
+    static void recycle(ErlNifEnv *env);
+
     std::shared_ptr<ErlNifEnv> m_env;
 };
 #endif
@@ -44,15 +69,53 @@ public:
 
 #if !defined(NO_ERLANG)
     nifpp::TERM toTerm(const Env &env) const;
+
+    /**
+     * Creates the atoms used in response terms, including one for every
+     * libcouchbase error. Must be called when the NIF library is loaded.
+     */
+    static void loadAtoms(ErlNifEnv *env);
 #endif
 
 protected:
+#if !defined(NO_ERLANG)
+    static nifpp::TERM okAtom();
+#endif
+
     lcb_error_t m_err;
 
 private:
-    std::string errorMessage() const;
+    static std::string errorMessage(lcb_error_t err);
 };
 
+#if !defined(NO_ERLANG)
+/**
+ * @c BatchBinary holds keys and values of all responses of a batch in
+ * a single binary and passes them to Erlang as its sub-binaries.
+ */
+class BatchBinary {
+public:
+    BatchBinary(const Env &env, std::size_t size);
+
+    /**
+     * Creates a batch binary that makes a separate binary for each piece
+     * of data, for when the size of the batch is not known up front.
+     */
+    explicit BatchBinary(const Env &env);
+
+    /**
+     * Copies @c data into the binary and returns a sub-binary of it.
+     */
+    nifpp::TERM add(folly::StringPiece data);
+
+private:
+    ErlNifEnv *m_env;
+    ERL_NIF_TERM m_binary;
+    unsigned char *m_data{nullptr};
+    std::size_t m_offset{0};
+};
+#endif
+
 } // namespace cb
 
 #endif // CBERL_RESPONSE_H
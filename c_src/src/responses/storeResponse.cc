@@ -24,16 +24,24 @@ StoreResponse::StoreResponse(
 {
 }
 
+void StoreResponse::copyInto(Arena &arena)
+{
+    m_key = arena.copy(m_key.data(), m_key.size());
+}
+
+std::size_t StoreResponse::binarySize() const { return m_key.size(); }
+
 #if !defined(NO_ERLANG)
-nifpp::TERM StoreResponse::toTerm(const Env &env) const
+nifpp::TERM StoreResponse::toTerm(const Env &env, BatchBinary &binary) const
 {
     if (m_err == LCB_SUCCESS) {
         return nifpp::make(env,
-            std::make_tuple(
-                m_key, std::make_tuple(nifpp::str_atom{"ok"}, m_cas)));
+            std::make_tuple(binary.add(m_key),
+                std::make_tuple(okAtom(), m_cas)));
     }
 
-    return nifpp::make(env, std::make_tuple(m_key, Response::toTerm(env)));
+    return nifpp::make(
+        env, std::make_tuple(binary.add(m_key), Response::toTerm(env)));
 }
 #endif
 
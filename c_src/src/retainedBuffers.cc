@@ -0,0 +1,91 @@
+/**
+ * @file retainedBuffers.cc
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#include "retainedBuffers.h"
+
+namespace cb {
+
+void RetainedBuffers::setEventBase(folly::EventBase *eventBase)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+    m_eventBase = eventBase;
+}
+
+BufferPtr RetainedBuffers::retain(lcb_BACKBUF buffer)
+{
+    lcb_backbuf_ref(buffer);
+    m_retained.fetch_add(1, std::memory_order_relaxed);
+
+    return BufferPtr{buffer, [self = shared_from_this()](const void *ptr) {
+        self->release(static_cast<lcb_BACKBUF>(const_cast<void *>(ptr)));
+    }};
+}
+
+void RetainedBuffers::drain()
+{
+    std::vector<lcb_BACKBUF> released;
+
+    {
+        std::lock_guard<std::mutex> guard{m_mutex};
+        if (m_released.empty())
+            return;
+
+        released.swap(m_released);
+    }
+
+    for (auto buffer : released)
+        lcb_backbuf_unref(buffer);
+
+    m_retained.fetch_sub(released.size(), std::memory_order_relaxed);
+}
+
+std::size_t RetainedBuffers::retained() const
+{
+    return m_retained.load(std::memory_order_relaxed);
+}
+
+void RetainedBuffers::close(lcb_t instance)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+
+    for (auto buffer : m_released)
+        lcb_backbuf_unref(buffer);
+
+    m_retained.fetch_sub(m_released.size(), std::memory_order_relaxed);
+    m_released.clear();
+
+    if (instance)
+        lcb_destroy(instance);
+
+    m_closed = true;
+}
+
+void RetainedBuffers::release(lcb_BACKBUF buffer)
+{
+    std::lock_guard<std::mutex> guard{m_mutex};
+
+    // No instance uses the buffers of a closed connection anymore, so the
+    // lock is enough to serialize their reference counts
+    if (m_closed) {
+        lcb_backbuf_unref(buffer);
+        m_retained.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+
+    m_released.push_back(buffer);
+
+    // Buffers queued after the first one are left to the same drain
+    if (m_released.size() == 1 && m_eventBase) {
+        m_eventBase->runInEventBaseThread(
+            [weak = std::weak_ptr<RetainedBuffers>{shared_from_this()}] {
+                if (auto self = weak.lock())
+                    self->drain();
+            });
+    }
+}
+
+} // namespace cb
@@ -0,0 +1,84 @@
+/**
+ * @file retainedBuffers.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_RETAINED_BUFFERS_H
+#define CBERL_RETAINED_BUFFERS_H
+
+#include "types.h"
+
+#include <folly/io/async/EventBase.h>
+#include <libcouchbase/couchbase.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cb {
+
+/**
+ * @c RetainedBuffers tracks the libcouchbase packet buffers of a
+ * connection handed over to Erlang. Buffers are reference counted by
+ * libcouchbase without synchronization, so those released on other
+ * threads are queued and unreferenced on the event base of the
+ * connection, where a drain is posted once the queue is no longer empty.
+ * Once the connection is closed, buffers are unreferenced as soon as
+ * they are released.
+ *
+ * A retained buffer keeps only this object alive, not the connection,
+ * its instance or its event base, which is used only until the
+ * connection is closed.
+ */
+class RetainedBuffers
+    : public std::enable_shared_from_this<RetainedBuffers> {
+public:
+    /**
+     * Sets the event base released buffers are unreferenced on, before
+     * any buffer is retained.
+     */
+    void setEventBase(folly::EventBase *eventBase);
+
+    /**
+     * Retains the buffer until the returned pointer is released, which
+     * may happen on any thread. Called on the event base of the
+     * connection.
+     */
+    BufferPtr retain(lcb_BACKBUF buffer);
+
+    /**
+     * Unreferences the buffers released since the last call. Called on
+     * the event base of the connection.
+     */
+    void drain();
+
+    /**
+     * Returns the number of buffers retained and not yet unreferenced.
+     * Can be called from any thread.
+     */
+    std::size_t retained() const;
+
+    /**
+     * Unreferences the released buffers and destroys the instance they
+     * belong to, after which buffers are unreferenced at once.
+     */
+    void close(lcb_t instance);
+
+private:
+    void release(lcb_BACKBUF buffer);
+
+    std::mutex m_mutex;
+    std::vector<lcb_BACKBUF> m_released;
+    folly::EventBase *m_eventBase{nullptr};
+    bool m_closed{false};
+
+    std::atomic<std::size_t> m_retained{0};
+};
+
+} // namespace cb
+
+#endif // CBERL_RETAINED_BUFFERS_H
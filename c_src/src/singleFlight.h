@@ -0,0 +1,87 @@
+/**
+ * @file singleFlight.h
+ * @author agent
+ * @copyright (C) 2026: agent
+ * This software is released under the MIT license cited in 'LICENSE.md'
+ */
+
+#ifndef CBERL_SINGLE_FLIGHT_H
+#define CBERL_SINGLE_FLIGHT_H
+
+#include <folly/Range.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cb {
+
+/**
+ * @c SingleFlight tracks keys with a get in flight on a connection, so
+ * that gets of the same key issued in the meantime wait for its
+ * response instead of being sent again. It is used only on the event
+ * base of its connection, except for its counters, which can be read from
+ * any thread.
+ */
+template <class WaiterT> class SingleFlight {
+public:
+    struct Stats {
+        std::uint64_t flights{0};
+        // Gets that waited for a flight, i.e. round trips saved
+        std::uint64_t joins{0};
+    };
+
+    /**
+     * Joins the get of a key in flight. If there is none, a flight of
+     * the key is started and @c false is returned; the caller is then
+     * expected to send the get and @c land the flight on its response.
+     */
+    bool join(folly::StringPiece key, WaiterT waiter)
+    {
+        auto result = m_flights.emplace(key.str(), std::vector<WaiterT>{});
+        if (result.second) {
+            m_started.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_joined.fetch_add(1, std::memory_order_relaxed);
+        result.first->second.push_back(std::move(waiter));
+        return true;
+    }
+
+    /**
+     * Ends the flight of a key and returns the waiters that joined it.
+     */
+    std::vector<WaiterT> land(folly::StringPiece key)
+    {
+        std::vector<WaiterT> waiters;
+        auto it = m_flights.find(key.str());
+        if (it != m_flights.end()) {
+            waiters = std::move(it->second);
+            m_flights.erase(it);
+        }
+
+        return waiters;
+    }
+
+    Stats stats() const
+    {
+        Stats stats;
+        stats.flights = m_started.load(std::memory_order_relaxed);
+        stats.joins = m_joined.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    std::unordered_map<std::string, std::vector<WaiterT>> m_flights;
+
+    std::atomic<std::uint64_t> m_started{0};
+    std::atomic<std::uint64_t> m_joined{0};
+};
+
+} // namespace cb
+
+#endif // CBERL_SINGLE_FLIGHT_H
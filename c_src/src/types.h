@@ -21,6 +21,11 @@ using ClientPtr = std::shared_ptr<Client>;
 using ConnectionPtr = std::shared_ptr<Connection>;
 using ConnectResponsePtr = std::shared_ptr<ConnectResponse>;
 
+/**
+ * Keeps memory owned by libcouchbase alive until released.
+ */
+using BufferPtr = std::shared_ptr<const void>;
+
 template <typename T> using Callback = std::function<void(const T &)>;
 
 } // namespace cb
@@ -14,9 +14,11 @@
 -behaviour(gen_server).
 
 %% API
--export([connect/6, connect/7, get/5, bulk_get/3, store/8, bulk_store/3, remove/4,
-    bulk_remove/3, arithmetic/6, bulk_arithmetic/3, http/7, durability/6,
-    bulk_durability/4]).
+-export([connect/6, connect/7, get/5, bulk_get/3, bulk_get_stream/6, store/8,
+    bulk_store/3, remove/4, bulk_remove/3, arithmetic/6, bulk_arithmetic/3,
+    http/7, durability/6, bulk_durability/4, near_cache_stats/1,
+    negative_cache_stats/1, hedged_read_stats/1, single_flight_stats/1,
+    request_stats/1, buffer_stats/1, handles/1, handles/2]).
 
 %% gen_server callbacks
 -export([init/1, handle_call/3, handle_cast/2, handle_info/2, terminate/2,
@@ -32,7 +34,32 @@
                        {view_timeout, pos_integer()} | % in microseconds
                        {durability_interval, pos_integer()} | % in microseconds
                        {durability_timeout, pos_integer()} | % in microseconds
-                       {http_timeout, pos_integer()}. % in microseconds
+                       {http_timeout, pos_integer()} | % in microseconds
+                       {shards, 1..64} | % libcouchbase instances
+                       {native_json, 0 | 1} | % decode JSON values in NIF
+                       % snappy compression: 0 - none, 1 - inflate received
+                       % values, 2 - deflate sent values, 3 - both
+                       {compression, 0..3} |
+                       {compression_min_size, non_neg_integer()} | % in bytes
+                       {single_flight, 0 | 1} | % coalesce gets of a key
+                       {near_cache_size, non_neg_integer()} | % in bytes
+                       {near_cache_ttl, non_neg_integer()} | % in milliseconds
+                       {negative_cache_size, non_neg_integer()} | % in keys
+                       {negative_cache_ttl, non_neg_integer()} | % in ms
+                       % read from replicas gets not answered in time,
+                       % 0 reads from them at once
+                       {hedged_read_delay, non_neg_integer()} | % in ms
+                       {max_in_flight, non_neg_integer()} | % operations
+                       {max_in_flight_bytes, non_neg_integer()} |
+                       % queue requests over the limit instead of failing
+                       % them with ebusy
+                       {in_flight_queue, 0 | 1} |
+                       % bound the queue, by default to the limit, and fail
+                       % requests over the bound with ebusy
+                       {max_queued_ops, non_neg_integer()} |
+                       {max_queued_bytes, non_neg_integer()} |
+                       % adjust the operation limit to the latency
+                       {in_flight_target_latency, non_neg_integer()}. % in us
 -type key() :: binary().
 -type value() :: binary() | jiffy:json_value() | term().
 -type encoder() :: none | json | raw.
@@ -60,7 +87,9 @@
 -export_type([persist_to/0, replicate_to/0]).
 
 -type get_request() :: {key(), expiry(), boolean()}.
--type get_response() :: {key(), {ok, cas(), value()} | {error, term()}}.
+-type get_response() :: {key(), {ok, cas(), value()} |
+                                {ok, cas(), value(), replica} |
+                                {error, term()}}.
 -type store_request() :: {store_operation(), key(), value(), encoder(), cas(),
                           expiry()}.
 -type store_response() :: {key(), {ok, cas()} | {error, term()}}.
@@ -121,11 +150,13 @@ connect(Host, Username, Password, Bucket, Opts, Timeout, Client) ->
 %% @end
 %%--------------------------------------------------------------------
 -spec get(connection(), key(), expiry(), boolean(), timeout()) ->
-    {ok, cas(), value()} | {error, Reason :: term()}.
+    {ok, cas(), value()} | {ok, cas(), value(), replica} |
+    {error, Reason :: term()}.
 get(Connection, Key, Expiry, Lock, Timeout) ->
     Requests = [{Key, Expiry, Lock}],
     case bulk_get(Connection, Requests, Timeout) of
         {ok, [{Key, {ok, Cas, Value}}]} -> {ok, Cas, Value};
+        {ok, [{Key, {ok, Cas, Value, replica}}]} -> {ok, Cas, Value, replica};
         {ok, [{Key, {error, Reason}}]} -> {error, Reason};
         {error, Reason} -> {error, Reason}
     end.
@@ -140,13 +171,28 @@ get(Connection, Key, Expiry, Lock, Timeout) ->
 bulk_get(Connection, Requests, Timeout) ->
     case call(Connection, {get, [Requests]}, Timeout) of
         {ok, Responses} ->
-            Responses2 = lists:map(fun
-                ({Key, {ok, Cas, Flags, Value}}) ->
-                    {Key, {ok, Cas, decode(Flags, Value)}};
-                ({Key, {error, Reason}}) ->
-                    {Key, {error, Reason}}
-            end, Responses),
-            {ok, Responses2};
+            {ok, decode_get_responses(Responses)};
+        {error, Reason} ->
+            {error, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns values from a CouchBase database using bulk request, folding
+%% chunks of responses with a function as they arrive. Timeout applies
+%% to each chunk.
+%% @end
+%%--------------------------------------------------------------------
+-spec bulk_get_stream(connection(), [get_request()],
+    fun(([get_response()], Acc) -> Acc), Acc, [cberl_nif:stream_opt()],
+    timeout()) -> {ok, Acc} | {error, Reason :: term()}.
+bulk_get_stream(Connection, Requests, Fun, Acc, StreamOpts, Timeout) ->
+    Request = {get, [Requests, StreamOpts]},
+    case request(Connection, Request, self(), Timeout) of
+        {ok, ResponseRef} ->
+            receive_chunks(ResponseRef, fun(Responses, Acc2) ->
+                Fun(decode_get_responses(Responses), Acc2)
+            end, Acc, Timeout);
         {error, Reason} ->
             {error, Reason}
     end.
@@ -279,6 +325,113 @@ durability(Connection, Key, Cas, PersistTo, ReplicateTo, Timeout) ->
 bulk_durability(Connection, Requests, Options, Timeout) ->
     call(Connection, {durability, [Requests, Options]}, Timeout).
 
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of gets served from and missed by the near cache of
+%% a connection.
+%% @end
+%%--------------------------------------------------------------------
+-spec near_cache_stats(connection()) ->
+    {ok, [{hits | misses, non_neg_integer()}]}.
+near_cache_stats(Connection) ->
+    {_, NifConnection} = handles(Connection),
+    cberl_nif:near_cache_stats(NifConnection).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of gets answered with key_enoent by the negative
+%% cache of a connection, i.e. the round trips saved, and the number of
+%% gets it has missed.
+%% @end
+%%--------------------------------------------------------------------
+-spec negative_cache_stats(connection()) ->
+    {ok, [{hits | misses, non_neg_integer()}]}.
+negative_cache_stats(Connection) ->
+    {_, NifConnection} = handles(Connection),
+    cberl_nif:negative_cache_stats(NifConnection).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of gets of a connection sent to the replicas of their
+%% keys as they have not been answered in time, and the number of gets
+%% answered by a replica.
+%% @end
+%%--------------------------------------------------------------------
+-spec hedged_read_stats(connection()) ->
+    {ok, [{hedged | replica_answers, non_neg_integer()}]}.
+hedged_read_stats(Connection) ->
+    {_, NifConnection} = handles(Connection),
+    cberl_nif:hedged_read_stats(NifConnection).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of gets sent by a connection with single flight
+%% enabled and the number of gets that waited for one of them instead.
+%% @end
+%%--------------------------------------------------------------------
+-spec single_flight_stats(connection()) ->
+    {ok, [{flights | joins, non_neg_integer()}]}.
+single_flight_stats(Connection) ->
+    {_, NifConnection} = handles(Connection),
+    cberl_nif:single_flight_stats(NifConnection).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of batches of a connection dropped as their caller
+%% has given up on them, i.e. timed out or died.
+%% @end
+%%--------------------------------------------------------------------
+-spec request_stats(connection()) -> {ok, [{dropped, non_neg_integer()}]}.
+request_stats(Connection) ->
+    {_, NifConnection} = handles(Connection),
+    cberl_nif:request_stats(NifConnection).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the number of libcouchbase packet buffers of a connection held
+%% by get values, which are released once the values are garbage
+%% collected.
+%% @end
+%%--------------------------------------------------------------------
+-spec buffer_stats(connection()) -> {ok, [{retained, non_neg_integer()}]}.
+buffer_stats(Connection) ->
+    {_, NifConnection} = handles(Connection),
+    cberl_nif:buffer_stats(NifConnection).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% @equiv handles(Connection, infinity)
+%% @end
+%%--------------------------------------------------------------------
+-spec handles(connection()) -> {cberl_nif:client(), cberl_nif:connection()}.
+handles(Connection) ->
+    handles(Connection, infinity).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Returns the NIF client and connection backing a connection, which can
+%% be passed to cberl_nif functions directly. The handles are fetched
+%% from the connection process once and cached in the calling process,
+%% so requests do not pass through the connection process. Cached
+%% handles are used only while the connection process is alive.
+%% @end
+%%--------------------------------------------------------------------
+-spec handles(connection(), timeout()) ->
+    {cberl_nif:client(), cberl_nif:connection()}.
+handles(Connection, Timeout) ->
+    case get({cberl_handles, Connection}) of
+        undefined ->
+            fetch_handles(Connection, Timeout);
+        Handles ->
+            case is_alive(Connection) of
+                true ->
+                    Handles;
+                false ->
+                    erase({cberl_handles, Connection}),
+                    fetch_handles(Connection, Timeout)
+            end
+    end.
+
 %%%===================================================================
 %%% gen_server callbacks
 %%%===================================================================
@@ -325,6 +478,12 @@ init([Host, Username, Password, Bucket, Opts, Timeout, Client]) ->
     {noreply, NewState :: state(), timeout() | hibernate} |
     {stop, Reason :: term(), Reply :: term(), NewState :: state()} |
     {stop, Reason :: term(), NewState :: state()}.
+handle_call(handles, _From, #state{} = State) ->
+    #state{
+        client = Client,
+        connection = Connection
+    } = State,
+    {reply, {Client, Connection}, State};
 handle_call(_Request, _From, #state{} = State) ->
     {noreply, State}.
 
@@ -338,22 +497,6 @@ handle_call(_Request, _From, #state{} = State) ->
     {noreply, NewState :: state()} |
     {noreply, NewState :: state(), timeout() | hibernate} |
     {stop, Reason :: term(), NewState :: state()}.
-handle_cast({request, Ref, From, {Function, Args}}, #state{} = State) ->
-    #state{
-        client = Client,
-        connection = Connection
-    } = State,
-    {ok, Ref2} = apply(cberl_nif, Function, [From, Client, Connection | Args]),
-    From ! {Ref, {ok, Ref2}},
-
-    case application:get_env(cberl, cberl_gc, on) of
-        on ->
-            erlang:garbage_collect();
-        _ ->
-            ok
-    end,
-
-    {noreply, State};
 handle_cast(_Request, #state{} = State) ->
     {noreply, State}.
 
@@ -403,25 +546,79 @@ code_change(_OldVsn, State, _Extra) ->
 %% @private
 %% @doc
 %% Sends request to a CouchBase database and awaits response with timeout.
+%% The request is given the deadline of the call, after which the NIF
+%% drops its response.
 %% @end
 %%--------------------------------------------------------------------
 -spec call(connection(), {Function :: atom(), Args :: list()}, timeout()) ->
     cberl_nif:response() | {error, Reason :: term()}.
-call(Connection, Request, Timeout) ->
-    Ref = make_ref(),
-    gen_server:cast(Connection, {request, Ref, self(), Request}),
-    case receive_response(Ref, Timeout) of
-        {ok, ResponseRef} -> receive_response(ResponseRef, Timeout);
+call(Connection, Request, infinity) ->
+    case request(Connection, Request, self(), infinity) of
+        {ok, ResponseRef} -> receive_response(ResponseRef, infinity);
         {error, Reason} -> {error, Reason}
+    end;
+call(Connection, Request, Timeout) ->
+    Deadline = erlang:monotonic_time(millisecond) + Timeout,
+    case request(Connection, Request, {self(), Deadline}, Timeout) of
+        {ok, ResponseRef} ->
+            Left = Deadline - erlang:monotonic_time(millisecond),
+            receive_response(ResponseRef, max(Left, 0));
+        {error, Reason} ->
+            {error, Reason}
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Submits request straight to the NIF connection and returns the id of
+%% its response, which is sent to the given process.
+%% @end
+%%--------------------------------------------------------------------
+-spec request(connection(), {Function :: atom(), Args :: list()},
+    cberl_nif:reply_to(), timeout()) ->
+    {ok, cberl_nif:request_id()} | {error, Reason :: term()}.
+request(Connection, {Function, Args}, ReplyTo, Timeout) ->
+    try handles(Connection, Timeout) of
+        {Client, NifConnection} ->
+            apply(cberl_nif, Function, [ReplyTo, Client, NifConnection | Args])
+    catch
+        exit:{Reason, {gen_server, call, _}} -> {error, Reason}
     end.
 
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Fetches the handles of a connection from its process and caches them
+%% in the calling process.
+%% @end
+%%--------------------------------------------------------------------
+-spec fetch_handles(connection(), timeout()) ->
+    {cberl_nif:client(), cberl_nif:connection()}.
+fetch_handles(Connection, Timeout) ->
+    Handles = gen_server:call(Connection, handles, Timeout),
+    put({cberl_handles, Connection}, Handles),
+    Handles.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Checks whether a connection process is alive. Only local processes
+%% are checked, as handles cannot be used on other nodes anyway.
+%% @end
+%%--------------------------------------------------------------------
+-spec is_alive(connection()) -> boolean().
+is_alive(Connection) when is_pid(Connection), node(Connection) == node() ->
+    is_process_alive(Connection);
+is_alive(_Connection) ->
+    true.
+
 %%--------------------------------------------------------------------
 %% @private
 %% @doc
 %% Waits with a timeout for a response associated with a reference.
 %% @end
 %%--------------------------------------------------------------------
--spec receive_response(reference() | cberl_nif:request_id(), timeout()) ->
+-spec receive_response(cberl_nif:request_id(), timeout()) ->
     cberl_nif:response() | {error, Reason :: term()}.
 receive_response(Ref, Timeout) ->
     receive
@@ -433,10 +630,50 @@ receive_response(Ref, Timeout) ->
 %%--------------------------------------------------------------------
 %% @private
 %% @doc
-%% Decodes value based on the encoding flag.
+%% Folds chunks of a streamed response until it is done or fails.
+%% Waits with a timeout for each chunk.
+%% @end
+%%--------------------------------------------------------------------
+-spec receive_chunks(cberl_nif:request_id(), fun((list(), Acc) -> Acc), Acc,
+    timeout()) -> {ok, Acc} | {error, Reason :: term()}.
+receive_chunks(Ref, Fun, Acc, Timeout) ->
+    receive
+        {Ref, {partial, Responses}} ->
+            receive_chunks(Ref, Fun, Fun(Responses, Acc), Timeout);
+        {Ref, done} -> {ok, Acc};
+        {Ref, {error, Reason}} -> {error, Reason}
+    after
+        Timeout -> {error, timeout}
+    end.
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Decodes values of get responses. Values read from a replica keep
+%% the trailing 'replica' mark.
+%% @end
+%%--------------------------------------------------------------------
+-spec decode_get_responses([cberl_nif:response()]) -> [get_response()].
+decode_get_responses(Responses) ->
+    lists:map(fun
+        ({Key, {ok, Cas, Flags, Value}}) ->
+            {Key, {ok, Cas, decode(Flags, Value)}};
+        ({Key, {ok, Cas, Flags, Value, replica}}) ->
+            {Key, {ok, Cas, decode(Flags, Value), replica}};
+        ({Key, {error, Reason}}) ->
+            {Key, {error, Reason}}
+    end, Responses).
+
+%%--------------------------------------------------------------------
+%% @private
+%% @doc
+%% Decodes value based on the encoding flag. JSON values decoded by
+%% the NIF are marked with 'json' instead of the flag.
 %% @end
 %%--------------------------------------------------------------------
--spec decode(cberl_nif:flags(), cberl_nif:value()) -> value().
+-spec decode(cberl_nif:flags() | json, cberl_nif:value() | value()) ->
+    value().
+decode(json, Value) -> Value;
 decode(0, Value) -> Value;
 decode(1, Value) -> jiffy:decode(Value);
 decode(2, Value) -> binary_to_term(Value).
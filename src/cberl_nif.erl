@@ -14,14 +14,22 @@
 -on_load(init/0).
 
 %% API
--export([new/0, connect/7, get/4, store/4, remove/4, arithmetic/4, http/4,
-    durability/5]).
+-export([new/0, new/1, connect/7, get/4, get/5, store/4, remove/4, arithmetic/4,
+    http/4, durability/5, near_cache_stats/1, negative_cache_stats/1,
+    hedged_read_stats/1, single_flight_stats/1, request_stats/1,
+    buffer_stats/1]).
 
 -type client() :: term().
 -type connection() :: term().
--type request_id() :: {integer(), integer(), integer()}.
+-type request_id() :: non_neg_integer().
+-type client_opt() :: {worker_count, pos_integer()}.
+-type stream_opt() :: {chunk_size, pos_integer()} |
+                      {chunk_interval, non_neg_integer()}. % in microseconds
+-type reply_to() :: pid() |
+                    {pid(), Deadline :: integer()}. % monotonic, in ms
 
--export_type([client/0, connection/0, request_id/0]).
+-export_type([client/0, connection/0, request_id/0, client_opt/0,
+    stream_opt/0, reply_to/0]).
 
 -type flags() :: non_neg_integer().
 -type value() :: binary().
@@ -34,6 +42,9 @@
 -type get_request() :: cberl:get_request().
 -type get_response() :: {cberl:key(),
                            {ok, cberl:cas(), flags(), value()} |
+                           {ok, cberl:cas(), json, jiffy:json_value()} |
+                           {ok, cberl:cas(), flags() | json,
+                               value() | jiffy:json_value(), replica} |
                            {error, term()}
                         }.
 -type store_request() :: {store_operation_id(), cberl:key(), value(), flags(),
@@ -62,11 +73,21 @@
 
 %%--------------------------------------------------------------------
 %% @doc
-%% Binding for NIF 'new' function.
+%% @equiv new([])
 %% @end
 %%--------------------------------------------------------------------
 -spec new() -> {ok, client()} | no_return().
 new() ->
+    new([]).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'new' function. The 'worker_count' option sets the
+%% number of IO threads shared by all connections created by the client.
+%% @end
+%%--------------------------------------------------------------------
+-spec new([client_opt()]) -> {ok, client()} | no_return().
+new(_Opts) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
 %%--------------------------------------------------------------------
@@ -84,18 +105,30 @@ connect(_From, _Client, _Host, _Username, _Password, _Bucket, _Opts) ->
 %% Binding for NIF 'get' function.
 %% @end
 %%--------------------------------------------------------------------
--spec get(pid(), client(), connection(), [get_request()]) ->
-    {ok, request_id()} | no_return().
+-spec get(reply_to(), client(), connection(), [get_request()]) ->
+    {ok, request_id()} | {error, ebusy} | no_return().
 get(_From, _Client, _Connection, _Requests) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'get' function streaming the responses. The responses
+%% are sent as '{partial, Responses}' chunks every 'chunk_size' keys
+%% and every 'chunk_interval' microseconds, followed by 'done'.
+%% @end
+%%--------------------------------------------------------------------
+-spec get(reply_to(), client(), connection(), [get_request()],
+    [stream_opt()]) -> {ok, request_id()} | {error, ebusy} | no_return().
+get(_From, _Client, _Connection, _Requests, _StreamOpts) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
 %%--------------------------------------------------------------------
 %% @doc
 %% Binding for NIF 'store' function.
 %% @end
 %%--------------------------------------------------------------------
--spec store(pid(), client(), connection(), [store_request()]) ->
-    {ok, request_id()} | no_return().
+-spec store(reply_to(), client(), connection(), [store_request()]) ->
+    {ok, request_id()} | {error, ebusy} | no_return().
 store(_From, _Client, _Connection, _Requests) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
@@ -104,8 +137,8 @@ store(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'remove' function.
 %% @end
 %%--------------------------------------------------------------------
--spec remove(pid(), client(), connection(), [remove_request()]) ->
-    {ok, request_id()} | no_return().
+-spec remove(reply_to(), client(), connection(), [remove_request()]) ->
+    {ok, request_id()} | {error, ebusy} | no_return().
 remove(_From, _Client, _Connection, _Requests) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
@@ -114,8 +147,8 @@ remove(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'arithmetic' function.
 %% @end
 %%--------------------------------------------------------------------
--spec arithmetic(pid(), client(), connection(), [arithmetic_request()]) ->
-    {ok, request_id()} | no_return().
+-spec arithmetic(reply_to(), client(), connection(), [arithmetic_request()]) ->
+    {ok, request_id()} | {error, ebusy} | no_return().
 arithmetic(_From, _Client, _Connection, _Requests) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
@@ -124,7 +157,7 @@ arithmetic(_From, _Client, _Connection, _Requests) ->
 %% Binding for NIF 'http' function.
 %% @end
 %%--------------------------------------------------------------------
--spec http(pid(), client(), connection(), http_request()) ->
+-spec http(reply_to(), client(), connection(), http_request()) ->
     {ok, request_id()} | no_return().
 http(_From, _Client, _Connection, _Request) ->
     erlang:nif_error(cberl_nif_not_loaded).
@@ -134,11 +167,72 @@ http(_From, _Client, _Connection, _Request) ->
 %% Binding for NIF 'durability' function.
 %% @end
 %%--------------------------------------------------------------------
--spec durability(pid(), client(), connection(), [durability_request()],
-    durability_options()) -> {ok, request_id()} | no_return().
+-spec durability(reply_to(), client(), connection(), [durability_request()],
+    durability_options()) ->
+    {ok, request_id()} | {error, ebusy} | no_return().
 durability(_From, _Client, _Connection, _Requests, _Options) ->
     erlang:nif_error(cberl_nif_not_loaded).
 
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'near_cache_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec near_cache_stats(connection()) ->
+    {ok, [{hits | misses, non_neg_integer()}]} | no_return().
+near_cache_stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'negative_cache_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec negative_cache_stats(connection()) ->
+    {ok, [{hits | misses, non_neg_integer()}]} | no_return().
+negative_cache_stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'hedged_read_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec hedged_read_stats(connection()) ->
+    {ok, [{hedged | replica_answers, non_neg_integer()}]} | no_return().
+hedged_read_stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'single_flight_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec single_flight_stats(connection()) ->
+    {ok, [{flights | joins, non_neg_integer()}]} | no_return().
+single_flight_stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'request_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec request_stats(connection()) ->
+    {ok, [{dropped, non_neg_integer()}]} | no_return().
+request_stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
+%%--------------------------------------------------------------------
+%% @doc
+%% Binding for NIF 'buffer_stats' function.
+%% @end
+%%--------------------------------------------------------------------
+-spec buffer_stats(connection()) ->
+    {ok, [{retained, non_neg_integer()}]} | no_return().
+buffer_stats(_Connection) ->
+    erlang:nif_error(cberl_nif_not_loaded).
+
 %%%===================================================================
 %%% Internal functions
 %%%===================================================================
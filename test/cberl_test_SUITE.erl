@@ -14,7 +14,7 @@
 -include_lib("common_test/include/ct.hrl").
 
 %% export for ct
--export([all/0, init_per_testcase/2]).
+-export([all/0, init_per_testcase/2, end_per_testcase/2]).
 
 %% tests
 -export([
@@ -22,13 +22,26 @@
     bulk_store_test/1,
     get_test/1,
     bulk_get_test/1,
+    bulk_get_stream_test/1,
     remove_test/1,
     bulk_remove_test/1,
     arithmetic_test/1,
     bulk_arithmetic_test/1,
     durability_test/1,
     bulk_durability_test/1,
-    http_test/1
+    http_test/1,
+    sharded_bulk_get_test/1,
+    shard_limit_test/1,
+    handles_test/1,
+    native_json_test/1,
+    near_cache_test/1,
+    negative_cache_test/1,
+    hedged_read_test/1,
+    in_flight_limit_test/1,
+    deadline_test/1,
+    dead_caller_test/1,
+    single_flight_test/1,
+    retained_buffer_test/1
 ]).
 
 all() -> [
@@ -36,13 +49,26 @@ all() -> [
     bulk_store_test,
     get_test,
     bulk_get_test,
+    bulk_get_stream_test,
     remove_test,
     bulk_remove_test,
     arithmetic_test,
     bulk_arithmetic_test,
     durability_test,
     bulk_durability_test,
-    http_test
+    http_test,
+    sharded_bulk_get_test,
+    shard_limit_test,
+    handles_test,
+    native_json_test,
+    near_cache_test,
+    negative_cache_test,
+    hedged_read_test,
+    in_flight_limit_test,
+    deadline_test,
+    dead_caller_test,
+    single_flight_test,
+    retained_buffer_test
 ].
 
 -define(TIMEOUT, timer:seconds(5)).
@@ -108,6 +134,20 @@ bulk_get_test(Config) ->
         {<<"k3">>, 0, false}
     ], ?TIMEOUT).
 
+bulk_get_stream_test(Config) ->
+    C = ?config(connection, Config),
+    Keys = [<<"k", (integer_to_binary(N))/binary>> || N <- lists:seq(1, 20)],
+    {ok, StoreResponses} = cberl:bulk_store(C, [
+        {set, Key, Key, none, 0, 0} || Key <- Keys
+    ], ?TIMEOUT),
+    20 = length([Key || {Key, {ok, _}} <- StoreResponses]),
+    {ok, Chunks} = cberl:bulk_get_stream(C, [
+        {Key, 0, false} || Key <- Keys
+    ], fun(Responses, Acc) -> [Responses | Acc] end, [],
+        [{chunk_size, 7}], ?TIMEOUT),
+    true = lists:all(fun(Chunk) -> length(Chunk) =< 7 end, Chunks),
+    [] = Keys -- [Key || {Key, {ok, _, Key}} <- lists:append(Chunks)].
+
 remove_test(Config) ->
     C = ?config(connection, Config),
     Key = <<"k">>,
@@ -229,16 +269,268 @@ bulk_durability_test(Config) ->
     RetrievedKeys = [S1, S2, S3, S4, S5, S6, S7, S8, S9, S10],
     lists:sort(StoredKeys) =:= lists:sort(RetrievedKeys).
 
+sharded_bulk_get_test(Config) ->
+    C = ?config(connection, Config),
+    Keys = [<<"k", (integer_to_binary(N))/binary>> || N <- lists:seq(1, 20)],
+    {ok, StoreResponses} = cberl:bulk_store(C, [
+        {set, Key, Key, none, 0, 0} || Key <- Keys
+    ], ?TIMEOUT),
+    20 = length([Key || {Key, {ok, _}} <- StoreResponses]),
+    {ok, GetResponses} = cberl:bulk_get(C, [
+        {Key, 0, false} || Key <- Keys
+    ], ?TIMEOUT),
+    [] = Keys -- [Key || {Key, {ok, _, Key}} <- GetResponses].
+
+shard_limit_test(Config) ->
+    Host = proplists:get_value(host, Config, <<"127.0.0.1">>),
+    {ok, Client} = cberl_nif:new([{worker_count, 4}]),
+    {'EXIT', {badarg, _}} = (catch cberl_nif:connect(self(), Client, Host,
+        <<>>, <<>>, <<"default">>, [{shards, 65}])).
+
+handles_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, _} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {Client, Connection} = cberl:handles(C),
+    {ok, ReqId} = cberl_nif:get(self(), Client, Connection, [
+        {<<"k1">>, 0, false}
+    ]),
+    receive
+        {ReqId, {ok, [{<<"k1">>, {ok, _, 0, <<"v1">>}}]}} -> ok
+    after
+        ?TIMEOUT -> ct:fail(timeout)
+    end,
+    % Malformed requests fail at once
+    {'EXIT', {badarg, _}} =
+        (catch cberl:get(C, <<"k1">>, bad_expiry, false, ?TIMEOUT)),
+    ok = gen_server:stop(C),
+    {error, noproc} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    undefined = get({cberl_handles, C}).
+
+native_json_test(Config) ->
+    C = ?config(connection, Config),
+    Value = {[
+        {<<"z">>, [1, 2.5, true, null, <<"v\n\x{e9}"/utf8>>]},
+        {<<"a">>, {[{<<"y">>, -3}, {<<"b">>, {[]}}]}},
+        {<<"m">>, []}
+    ]},
+    {ok, Cas} = cberl:store(C, set, <<"k2">>, Value, json, 0, 0, ?TIMEOUT),
+    {ok, Cas, Value} = cberl:get(C, <<"k2">>, 0, false, ?TIMEOUT),
+    % Left for jiffy
+    BigValue = {[{<<"k">>, 1 bsl 64}, {<<"a">>, 1}]},
+    {ok, BigCas} = cberl:store(C, set, <<"k2">>, BigValue, json, 0, 0,
+        ?TIMEOUT),
+    {ok, BigCas, BigValue} = cberl:get(C, <<"k2">>, 0, false, ?TIMEOUT).
+
+near_cache_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, Cas1} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, Cas1, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, Cas1, <<"v1">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, [{hits, 1}, {misses, 1}]} = cberl:near_cache_stats(C),
+    {ok, Cas2} = cberl:store(C, set, <<"k1">>, <<"v2">>, none, 0, 0, ?TIMEOUT),
+    {ok, Cas2, <<"v2">>} = cberl:get(C, <<"k1">>, 0, false, ?TIMEOUT),
+    {ok, [{hits, 1}, {misses, 2}]} = cberl:near_cache_stats(C).
+
+negative_cache_test(Config) ->
+    C = ?config(connection, Config),
+    cberl:remove(C, <<"k7">>, 0, ?TIMEOUT),
+    {error, key_enoent} = cberl:get(C, <<"k7">>, 0, false, ?TIMEOUT),
+    {error, key_enoent} = cberl:get(C, <<"k7">>, 0, false, ?TIMEOUT),
+    {ok, [{hits, 1}, {misses, 1}]} = cberl:negative_cache_stats(C),
+    {ok, Cas} = cberl:store(C, set, <<"k7">>, <<"v7">>, none, 0, 0, ?TIMEOUT),
+    {ok, Cas, <<"v7">>} = cberl:get(C, <<"k7">>, 0, false, ?TIMEOUT),
+    {ok, [{hits, 1}, {misses, 2}]} = cberl:negative_cache_stats(C).
+
+hedged_read_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, Cas} = cberl:store(C, set, <<"k8">>, <<"v8">>, none, 0, 0, ?TIMEOUT),
+    Keys = [<<"k8">> || _ <- lists:seq(1, 100)],
+    {ok, Responses} = cberl:bulk_get(C, [
+        {Key, 0, false} || Key <- Keys
+    ], ?TIMEOUT),
+    true = lists:all(fun
+        ({<<"k8">>, {ok, Cas2, <<"v8">>}}) -> Cas2 == Cas;
+        ({<<"k8">>, {ok, _, <<"v8">>, replica}}) -> true;
+        (_) -> false
+    end, Responses),
+    ReplicaAnswers = length([Key || {Key, {_, _, _, replica}} <- Responses]),
+    {ok, [{hedged, Hedged}, {replica_answers, ReplicaAnswers}]} =
+        cberl:hedged_read_stats(C),
+    true = Hedged > 0.
+
+in_flight_limit_test(Config) ->
+    LC = ?config(limited_connection, Config),
+    QC = ?config(queueing_connection, Config),
+    BC = ?config(bounded_connection, Config),
+    {ok, _} = cberl:store(LC, set, <<"k9">>, <<"v9">>, none, 0, 0, ?TIMEOUT),
+    Get = fun(C) ->
+        cberl:bulk_get(C, [{<<"k9">>, 0, false} || _ <- lists:seq(1, 10)],
+            ?TIMEOUT)
+    end,
+    Self = self(),
+    Results = fun(C) ->
+        Pids = [spawn_link(fun() -> Self ! {self(), Get(C)} end)
+            || _ <- lists:seq(1, 20)],
+        [receive {Pid, Result} -> Result after ?TIMEOUT -> timeout end
+            || Pid <- Pids]
+    end,
+    LResults = Results(LC),
+    true = lists:all(fun
+        ({ok, Responses}) -> length(Responses) == 10;
+        ({error, ebusy}) -> true;
+        (_) -> false
+    end, LResults),
+    true = lists:any(fun(Result) -> element(1, Result) == ok end, LResults),
+    true = lists:all(fun
+        ({ok, Responses}) -> length(Responses) == 10;
+        (_) -> false
+    end, Results(QC)),
+    % Requests submitted at once, one in flight and one queued
+    {Client, NifConnection} = cberl:handles(BC),
+    Submitted = [cberl_nif:get(self(), Client, NifConnection,
+        [{<<"k9">>, 0, false} || _ <- lists:seq(1, 10)])
+        || _ <- lists:seq(1, 20)],
+    ReqIds = [ReqId || {ok, ReqId} <- Submitted],
+    true = length(ReqIds) >= 2,
+    true = lists:member({error, ebusy}, Submitted),
+    lists:foreach(fun(ReqId) ->
+        receive
+            {ReqId, {ok, Responses}} -> 10 = length(Responses)
+        after
+            ?TIMEOUT -> ct:fail(timeout)
+        end
+    end, ReqIds).
+
+deadline_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, Cas} = cberl:store(C, set, <<"k11">>, <<"v11">>, none, 0, 0, ?TIMEOUT),
+    Requests = [{<<"k11">>, 0, false} || _ <- lists:seq(1, 100)],
+    {error, timeout} = cberl:bulk_get(C, Requests, 0),
+    receive
+        Message -> ct:fail({unexpected, Message})
+    after
+        100 -> ok
+    end,
+    {ok, Cas, <<"v11">>} = cberl:get(C, <<"k11">>, 0, false, ?TIMEOUT).
+
+dead_caller_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, Cas} = cberl:store(C, set, <<"k12">>, <<"v12">>, none, 0, 0, ?TIMEOUT),
+    {Client, NifConnection} = cberl:handles(C),
+    {Pid, Ref} = spawn_monitor(fun() -> ok end),
+    receive
+        {'DOWN', Ref, process, Pid, normal} -> ok
+    after
+        ?TIMEOUT -> ct:fail(timeout)
+    end,
+    % The caller is gone before the batch is dispatched, so it is dropped
+    % without being sent
+    Requests = [{<<"k12">>, 0, false} || _ <- lists:seq(1, 1000)],
+    {ok, _} = cberl_nif:get(Pid, Client, NifConnection, Requests),
+    % Requests of a key run in order on its shard, so the batch is done
+    {ok, Cas, <<"v12">>} = cberl:get(C, <<"k12">>, 0, false, ?TIMEOUT),
+    {ok, [{dropped, 1}]} = cberl:request_stats(C).
+
+single_flight_test(Config) ->
+    C = ?config(connection, Config),
+    {ok, Cas} = cberl:store(C, set, <<"k1">>, <<"v1">>, none, 0, 0, ?TIMEOUT),
+    {ok, Responses} = cberl:bulk_get(C, [
+        {<<"k1">>, 0, false} || _ <- lists:seq(1, 10)
+    ], ?TIMEOUT),
+    10 = length([ok || {<<"k1">>, {ok, Cas, <<"v1">>}} <- Responses]),
+    {ok, [{flights, 1}, {joins, 9}]} = cberl:single_flight_stats(C),
+    Self = self(),
+    Pids = [spawn_link(fun() ->
+        Self ! {self(), cberl:bulk_get(C, [
+            {<<"k1">>, 0, false},
+            {<<"k1">>, 0, false}
+        ], ?TIMEOUT)}
+    end) || _ <- lists:seq(1, 10)],
+    lists:foreach(fun(Pid) ->
+        receive
+            {Pid, Response} ->
+                {ok, [
+                    {<<"k1">>, {ok, Cas, <<"v1">>}},
+                    {<<"k1">>, {ok, Cas, <<"v1">>}}
+                ]} = Response
+        after
+            ?TIMEOUT -> ct:fail(timeout)
+        end
+    end, Pids),
+    {ok, [{flights, Flights}, {joins, Joins}]} = cberl:single_flight_stats(C),
+    30 = Flights + Joins,
+    true = Flights =< 11.
+
+retained_buffer_test(Config) ->
+    C = ?config(connection, Config),
+    Value = binary:copy(<<"v">>, 64 * 1024),
+    {ok, _} = cberl:store(C, set, <<"k13">>, Value, none, 0, 0, ?TIMEOUT),
+    {Pid, Ref} = spawn_monitor(fun() ->
+        {ok, _, Value} = cberl:get(C, <<"k13">>, 0, false, ?TIMEOUT),
+        {ok, [{retained, 1}]} = cberl:buffer_stats(C)
+    end),
+    receive
+        {'DOWN', Ref, process, Pid, normal} -> ok
+    after
+        ?TIMEOUT -> ct:fail(timeout)
+    end,
+    % The value is gone with the process, nothing is sent afterwards
+    wait_for(fun() -> cberl:buffer_stats(C) == {ok, [{retained, 0}]} end).
+
 %%%===================================================================
 %%% Init/teardown functions
 %%%===================================================================
 
+init_per_testcase(Case, Config) when Case == sharded_bulk_get_test;
+                                     Case == deadline_test;
+                                     Case == dead_caller_test ->
+    {ok, Client} = cberl_nif:new([{worker_count, 4}]),
+    connect(connection, [{shards, 4}], Client, Config);
+init_per_testcase(native_json_test, Config) ->
+    connect(connection, [{native_json, 1}], Config);
+init_per_testcase(near_cache_test, Config) ->
+    connect(connection, [{near_cache_size, 1024 * 1024}], Config);
+init_per_testcase(negative_cache_test, Config) ->
+    connect(connection, [{negative_cache_size, 1024}], Config);
+init_per_testcase(hedged_read_test, Config) ->
+    connect(connection, [{hedged_read_delay, 0}, {single_flight, 0}], Config);
+init_per_testcase(in_flight_limit_test, Config) ->
+    Config2 = connect(limited_connection, [{max_in_flight, 10}], Config),
+    Config3 = connect(queueing_connection,
+        [{max_in_flight, 10}, {in_flight_queue, 1}, {max_queued_ops, 1000}],
+        Config2),
+    connect(bounded_connection,
+        [{max_in_flight, 10}, {in_flight_queue, 1}, {max_queued_ops, 10}],
+        Config3);
+init_per_testcase(shard_limit_test, Config) ->
+    Config;
+init_per_testcase(retained_buffer_test, Config) ->
+    connect(connection, [{compression, 0}], Config);
 init_per_testcase(_Case, Config) ->
+    connect(connection, [], Config).
+
+end_per_testcase(_Case, Config) ->
+    lists:foreach(fun(Key) ->
+        case ?config(Key, Config) of
+            undefined -> ok;
+            C -> catch gen_server:stop(C)
+        end
+    end, [connection, limited_connection, queueing_connection,
+        bounded_connection]).
+
+%%%===================================================================
+%%% Internal functions
+%%%===================================================================
+
+connect(Key, ExtraOpts, Config) ->
+    connect(Key, ExtraOpts, undefined, Config).
+
+connect(Key, ExtraOpts, Client, Config) ->
     Host = proplists:get_value(host, Config, <<"127.0.0.1">>),
     Username = proplists:get_value(username, Config, <<>>),
     Password = proplists:get_value(password, Config, <<>>),
     Bucket = proplists:get_value(bucket, Config, <<"default">>),
-    Opts = [
+    Opts = ExtraOpts ++ [
         {operation_timeout, 5000000},
         {config_total_timeout, 5000000},
         {view_timeout, 60000000},
@@ -246,5 +538,25 @@ init_per_testcase(_Case, Config) ->
         {durability_timeout, 30000000},
         {http_timeout, 10000000}
     ],
-    {ok, C} = cberl:connect(Host, Username, Password, Bucket, Opts, ?TIMEOUT),
-    [{connection, C} | Config].
+    {ok, C} = case Client of
+        undefined ->
+            cberl:connect(Host, Username, Password, Bucket, Opts, ?TIMEOUT);
+        _ ->
+            cberl:connect(Host, Username, Password, Bucket, Opts, ?TIMEOUT,
+                Client)
+    end,
+    [{Key, C} | Config].
+
+wait_for(Condition) ->
+    wait_for(Condition, 50).
+
+wait_for(_Condition, 0) ->
+    ct:fail(timeout);
+wait_for(Condition, Attempts) ->
+    case Condition() of
+        true ->
+            ok;
+        false ->
+            timer:sleep(100),
+            wait_for(Condition, Attempts - 1)
+    end.